@@ -0,0 +1,63 @@
+#pragma once
+
+// Замена аллокатора из тестера курса, чтобы task-4-B собирался в
+// бенчмарках. Выделяет память блоками, объекты живут до уничтожения
+// аллокатора, деструкторы не вызываются.
+// Провилков Иван.
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+class ArenaAllocator {
+ public:
+  ArenaAllocator() {
+    AddBlock();
+  }
+
+  ArenaAllocator(const ArenaAllocator&) = delete;
+  ArenaAllocator& operator=(const ArenaAllocator&) = delete;
+
+  template <typename T, typename... Args>
+  T* New(Args&&... args) {
+    return new (Allocate(sizeof(T))) T(std::forward<Args>(args)...);
+  }
+
+  void* Allocate(size_t bytes) {
+    bytes = (bytes + kAlignment - 1) / kAlignment * kAlignment;
+    while (true) {
+      Block* block = current_.load(std::memory_order_acquire);
+      const size_t offset =
+          block->used.fetch_add(bytes, std::memory_order_relaxed);
+      if (offset + bytes <= kBlockSize) {
+        return block->data + offset;
+      }
+      std::lock_guard<std::mutex> locker(blocks_mutex_);
+      if (current_.load(std::memory_order_relaxed) == block) {
+        AddBlock();
+      }
+    }
+  }
+
+ private:
+  static constexpr size_t kBlockSize = 1 << 20;
+  static constexpr size_t kAlignment = alignof(std::max_align_t);
+
+  struct Block {
+    std::atomic<size_t> used{0};
+    alignas(std::max_align_t) char data[kBlockSize];
+  };
+
+  void AddBlock() {
+    blocks_.push_back(std::make_unique<Block>());
+    current_.store(blocks_.back().get(), std::memory_order_release);
+  }
+
+  std::mutex blocks_mutex_;
+  std::vector<std::unique_ptr<Block>> blocks_;
+  std::atomic<Block*> current_{nullptr};
+};
@@ -0,0 +1,643 @@
+// Общий каркас микробенчмарков: перебор параметров, запуск, отчеты.
+// Провилков Иван. гр.593.
+
+#include "bench.h"
+
+#include "../lock_profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <tuple>
+
+namespace bench {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Benchmark {
+  std::string name;
+  unsigned axes;
+  WorkloadFactory factory;
+};
+
+std::vector<Benchmark>& Registry() {
+  static std::vector<Benchmark> registry;
+  return registry;
+}
+
+enum class Format {
+  kTable,
+  kCsv,
+  kJson,
+};
+
+struct Options {
+  std::vector<size_t> threads;
+  std::vector<double> read_ratios{0.9};
+  std::vector<KeyDistribution> distributions{KeyDistribution::kUniform,
+                                             KeyDistribution::kZipf};
+  std::vector<size_t> capacities{16, 1024};
+  size_t key_range = 1 << 16;
+  double zipf_theta = 0.99;
+  int64_t duration_ms = 200;
+  // Задержку меряем у каждой sample_every-й операции: вызов часов
+  // сравним по стоимости с захватом свободного мьютекса.
+  uint64_t sample_every = 16;
+  std::string filter;
+  Format format = Format::kTable;
+  std::string output;
+  std::string baseline;
+  double tolerance = 0.10;
+  double latency_tolerance = 0.25;
+  bool list = false;
+};
+
+struct Result {
+  std::string name;
+  unsigned axes = 0;
+  Params params;
+  uint64_t operations = 0;
+  double seconds = 0;
+  double ops_per_sec = 0;
+  double p50_ns = 0;
+  double p99_ns = 0;
+  double p999_ns = 0;
+  double speedup = 1;
+  bool regression = false;
+};
+
+///////////////////////////////////////////////////////////////////////
+// Параметры командной строки.
+
+template <class T, class Parse>
+std::vector<T> ParseList(const std::string& text, Parse parse) {
+  std::vector<T> values;
+  std::stringstream stream(text);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    if (!item.empty()) {
+      values.push_back(parse(item));
+    }
+  }
+  return values;
+}
+
+KeyDistribution ParseDistribution(const std::string& name) {
+  if (name == "uniform") {
+    return KeyDistribution::kUniform;
+  }
+  if (name == "zipf") {
+    return KeyDistribution::kZipf;
+  }
+  std::cerr << "unknown distribution: " << name << std::endl;
+  std::exit(1);
+}
+
+const char* DistributionName(const KeyDistribution distribution) {
+  return distribution == KeyDistribution::kZipf ? "zipf" : "uniform";
+}
+
+std::vector<size_t> DefaultThreadCounts() {
+  const size_t hardware =
+      std::max<size_t>(std::thread::hardware_concurrency(), 1);
+  std::vector<size_t> counts;
+  for (size_t threads = 1; threads < hardware; threads *= 2) {
+    counts.push_back(threads);
+  }
+  counts.push_back(hardware);
+  return counts;
+}
+
+void PrintUsage(const char* program) {
+  std::cerr
+      << "usage: " << program << " [options]\n"
+      << "  --threads=1,2,4        thread counts to sweep\n"
+      << "  --read-ratios=0.5,0.9  share of read operations\n"
+      << "  --distributions=uniform,zipf\n"
+      << "  --zipf-theta=0.99      skew of the Zipf distribution\n"
+      << "  --keys=65536           key range\n"
+      << "  --capacities=16,1024   queue capacities\n"
+      << "  --duration-ms=200      run time of every point\n"
+      << "  --sample-every=16      measure latency of every N-th operation\n"
+      << "  --filter=substring     run only matching benchmarks\n"
+      << "  --format=table|csv|json\n"
+      << "  --out=path             write results to a file\n"
+      << "  --baseline=path.csv    compare with a stored csv run\n"
+      << "  --tolerance=0.10       allowed throughput drop\n"
+      << "  --latency-tolerance=0.25  allowed p99 growth\n"
+      << "  --list                 list benchmarks\n";
+}
+
+Options ParseOptions(const int argc, char** argv) {
+  Options options;
+  options.threads = DefaultThreadCounts();
+  for (int i = 1; i < argc; ++i) {
+    const std::string argument = argv[i];
+    const size_t equals = argument.find('=');
+    const std::string key = argument.substr(0, equals);
+    const std::string value =
+        equals == std::string::npos ? "" : argument.substr(equals + 1);
+    auto to_size = [](const std::string& text) {
+      return static_cast<size_t>(std::stoull(text));
+    };
+    auto to_double = [](const std::string& text) { return std::stod(text); };
+    if (key == "--threads") {
+      options.threads = ParseList<size_t>(value, to_size);
+    } else if (key == "--read-ratios") {
+      options.read_ratios = ParseList<double>(value, to_double);
+    } else if (key == "--distributions") {
+      options.distributions =
+          ParseList<KeyDistribution>(value, ParseDistribution);
+    } else if (key == "--zipf-theta") {
+      options.zipf_theta = to_double(value);
+    } else if (key == "--keys") {
+      options.key_range = std::max<size_t>(to_size(value), 1);
+    } else if (key == "--capacities") {
+      options.capacities = ParseList<size_t>(value, to_size);
+    } else if (key == "--duration-ms") {
+      options.duration_ms = std::stoll(value);
+    } else if (key == "--sample-every") {
+      options.sample_every = std::max<uint64_t>(to_size(value), 1);
+    } else if (key == "--filter") {
+      options.filter = value;
+    } else if (key == "--format") {
+      if (value == "table") {
+        options.format = Format::kTable;
+      } else if (value == "csv") {
+        options.format = Format::kCsv;
+      } else if (value == "json") {
+        options.format = Format::kJson;
+      } else {
+        PrintUsage(argv[0]);
+        std::exit(1);
+      }
+    } else if (key == "--out") {
+      options.output = value;
+    } else if (key == "--baseline") {
+      options.baseline = value;
+    } else if (key == "--tolerance") {
+      options.tolerance = to_double(value);
+    } else if (key == "--latency-tolerance") {
+      options.latency_tolerance = to_double(value);
+    } else if (key == "--list") {
+      options.list = true;
+    } else {
+      PrintUsage(argv[0]);
+      std::exit(key == "--help" ? 0 : 1);
+    }
+  }
+  return options;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Запуск одной точки.
+
+double Percentile(std::vector<uint64_t>& samples, const double quantile) {
+  if (samples.empty()) {
+    return 0;
+  }
+  const size_t rank = std::min(
+      samples.size() - 1,
+      static_cast<size_t>(quantile * static_cast<double>(samples.size())));
+  std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+  return static_cast<double>(samples[rank]);
+}
+
+Result RunPoint(const Benchmark& benchmark, Params params,
+                const Options& options) {
+  // Не даем одному потоку копить бесконечно много замеров.
+  constexpr size_t kMaxSamplesPerThread = 1 << 20;
+
+  std::unique_ptr<Workload> workload = benchmark.factory(params);
+  const uint64_t fixed_operations = workload->FixedOperationsPerThread();
+  const size_t clients = workload->SingleClient() ? 1 : params.threads;
+
+  std::atomic<size_t> ready(0);
+  std::atomic<bool> start(false);
+  std::atomic<bool> stop(false);
+  std::vector<uint64_t> operations(clients, 0);
+  std::vector<std::vector<uint64_t>> samples(clients);
+  std::vector<Clock::time_point> finish(clients);
+
+  std::vector<std::thread> threads;
+  for (size_t index = 0; index < clients; ++index) {
+    threads.emplace_back([&, index] {
+      ThreadContext context(params, index);
+      std::vector<uint64_t>& thread_samples = samples[index];
+      thread_samples.reserve(1 << 12);
+      ready.fetch_add(1);
+      while (!start.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+      }
+      uint64_t done = 0;
+      while (fixed_operations != 0 ? done < fixed_operations
+                                   : !stop.load(std::memory_order_relaxed)) {
+        if (done % options.sample_every == 0 &&
+            thread_samples.size() < kMaxSamplesPerThread) {
+          const Clock::time_point begin = Clock::now();
+          workload->Operation(context);
+          thread_samples.push_back(static_cast<uint64_t>(
+              std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  Clock::now() - begin).count()));
+        } else {
+          workload->Operation(context);
+        }
+        ++done;
+      }
+      operations[index] = done;
+      finish[index] = Clock::now();
+    });
+  }
+
+  while (ready.load() != clients) {
+    std::this_thread::yield();
+  }
+  const Clock::time_point begin = Clock::now();
+  start.store(true, std::memory_order_release);
+  if (fixed_operations == 0) {
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds(options.duration_ms));
+    stop.store(true);
+    workload->Stop();
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  workload.reset();
+
+  Result result;
+  result.name = benchmark.name;
+  result.axes = benchmark.axes;
+  result.params = params;
+  const Clock::time_point end = *std::max_element(finish.begin(),
+                                                  finish.end());
+  result.seconds = std::chrono::duration<double>(end - begin).count();
+  std::vector<uint64_t> all_samples;
+  for (size_t index = 0; index < clients; ++index) {
+    result.operations += operations[index];
+    all_samples.insert(all_samples.end(), samples[index].begin(),
+                       samples[index].end());
+  }
+  result.ops_per_sec = result.seconds > 0
+      ? static_cast<double>(result.operations) / result.seconds : 0;
+  result.p50_ns = Percentile(all_samples, 0.50);
+  result.p99_ns = Percentile(all_samples, 0.99);
+  result.p999_ns = Percentile(all_samples, 0.999);
+  return result;
+}
+
+// Перебираем только те оси, которые важны бенчмарку.
+std::vector<Params> Sweep(const Benchmark& benchmark, const Options& options) {
+  Params base;
+  base.key_range = options.key_range;
+  base.zipf_theta = options.zipf_theta;
+  std::vector<Params> points{base};
+  auto expand = [&points](auto values, auto assign) {
+    std::vector<Params> expanded;
+    for (const Params& point : points) {
+      for (const auto& value : values) {
+        Params next = point;
+        assign(next, value);
+        expanded.push_back(next);
+      }
+    }
+    points.swap(expanded);
+  };
+  if (benchmark.axes & kCapacityAxis) {
+    expand(options.capacities,
+           [](Params& params, size_t value) { params.capacity = value; });
+  }
+  if (benchmark.axes & kDistributionAxis) {
+    expand(options.distributions, [](Params& params, KeyDistribution value) {
+      params.distribution = value;
+    });
+  }
+  if (benchmark.axes & kReadRatioAxis) {
+    expand(options.read_ratios,
+           [](Params& params, double value) { params.read_ratio = value; });
+  }
+  if (benchmark.axes & kThreadsAxis) {
+    expand(options.threads,
+           [](Params& params, size_t value) { params.threads = value; });
+  }
+  return points;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Отчеты и сравнение с базовым прогоном.
+
+std::string FormatDouble(const double value, const int precision) {
+  char buffer[64];
+  std::snprintf(buffer, sizeof(buffer), "%.*f", precision, value);
+  return buffer;
+}
+
+// Значения параметров в том виде, в котором они попадают в CSV. Оси,
+// которые бенчмарк не использует, печатаются как "-".
+std::vector<std::string> ParamColumns(const Result& result) {
+  const Params& params = result.params;
+  return {
+      result.name,
+      std::to_string(params.threads),
+      result.axes & kReadRatioAxis ? FormatDouble(params.read_ratio, 3) : "-",
+      result.axes & kDistributionAxis ? DistributionName(params.distribution)
+                                      : "-",
+      result.axes & kCapacityAxis ? std::to_string(params.capacity) : "-",
+  };
+}
+
+std::string ResultKey(const std::vector<std::string>& param_columns) {
+  std::string key;
+  for (const std::string& column : param_columns) {
+    key += column;
+    key += '|';
+  }
+  return key;
+}
+
+const char* kCsvHeader =
+    "benchmark,threads,read_ratio,distribution,capacity,operations,seconds,"
+    "ops_per_sec,p50_ns,p99_ns,p999_ns,speedup";
+
+void WriteCsv(std::ostream& out, const std::vector<Result>& results) {
+  out << kCsvHeader << "\n";
+  for (const Result& result : results) {
+    for (const std::string& column : ParamColumns(result)) {
+      out << column << ",";
+    }
+    out << result.operations << "," << FormatDouble(result.seconds, 4) << ","
+        << FormatDouble(result.ops_per_sec, 1) << ","
+        << FormatDouble(result.p50_ns, 0) << ","
+        << FormatDouble(result.p99_ns, 0) << ","
+        << FormatDouble(result.p999_ns, 0) << ","
+        << FormatDouble(result.speedup, 3) << "\n";
+  }
+}
+
+void WriteJson(std::ostream& out, const std::vector<Result>& results) {
+  out << "[\n";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result& result = results[i];
+    const std::vector<std::string> columns = ParamColumns(result);
+    out << "  {\"benchmark\": \"" << columns[0] << "\", \"threads\": "
+        << columns[1] << ", \"read_ratio\": \"" << columns[2]
+        << "\", \"distribution\": \"" << columns[3] << "\", \"capacity\": \""
+        << columns[4] << "\", \"operations\": " << result.operations
+        << ", \"seconds\": " << FormatDouble(result.seconds, 4)
+        << ", \"ops_per_sec\": " << FormatDouble(result.ops_per_sec, 1)
+        << ", \"p50_ns\": " << FormatDouble(result.p50_ns, 0)
+        << ", \"p99_ns\": " << FormatDouble(result.p99_ns, 0)
+        << ", \"p999_ns\": " << FormatDouble(result.p999_ns, 0)
+        << ", \"speedup\": " << FormatDouble(result.speedup, 3)
+        << ", \"regression\": " << (result.regression ? "true" : "false")
+        << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+  out << "]\n";
+}
+
+void WriteTable(std::ostream& out, const std::vector<Result>& results) {
+  char line[256];
+  std::snprintf(line, sizeof(line),
+                "%-36s %7s %6s %8s %8s %14s %9s %9s %9s %7s\n", "benchmark",
+                "threads", "reads", "keys", "capacity", "ops/sec", "p50 ns",
+                "p99 ns", "p999 ns", "speedup");
+  out << line;
+  for (const Result& result : results) {
+    const std::vector<std::string> columns = ParamColumns(result);
+    std::snprintf(line, sizeof(line),
+                  "%-36s %7s %6s %8s %8s %14.0f %9.0f %9.0f %9.0f %7.2f%s\n",
+                  columns[0].c_str(), columns[1].c_str(), columns[2].c_str(),
+                  columns[3].c_str(), columns[4].c_str(), result.ops_per_sec,
+                  result.p50_ns, result.p99_ns, result.p999_ns,
+                  result.speedup, result.regression ? "  REGRESSION" : "");
+    out << line;
+  }
+}
+
+// Читает CSV, записанный WriteCsv: ключ параметров -> (ops/sec, p99).
+std::map<std::string, std::pair<double, double>> ReadBaseline(
+    const std::string& path) {
+  std::map<std::string, std::pair<double, double>> baseline;
+  std::ifstream in(path);
+  if (!in) {
+    std::cerr << "cannot read baseline " << path << std::endl;
+    std::exit(1);
+  }
+  std::string line;
+  std::getline(in, line);
+  while (std::getline(in, line)) {
+    std::vector<std::string> columns;
+    std::stringstream stream(line);
+    std::string column;
+    while (std::getline(stream, column, ',')) {
+      columns.push_back(column);
+    }
+    if (columns.size() < 12) {
+      continue;
+    }
+    const std::vector<std::string> param_columns(columns.begin(),
+                                                 columns.begin() + 5);
+    baseline[ResultKey(param_columns)] = {std::stod(columns[7]),
+                                          std::stod(columns[9])};
+  }
+  return baseline;
+}
+
+// Помечает регрессии и возвращает их количество.
+size_t CompareWithBaseline(std::vector<Result>& results,
+                           const Options& options) {
+  const auto baseline = ReadBaseline(options.baseline);
+  size_t regressions = 0;
+  for (Result& result : results) {
+    const auto found = baseline.find(ResultKey(ParamColumns(result)));
+    if (found == baseline.end()) {
+      continue;
+    }
+    const double base_throughput = found->second.first;
+    const double base_p99 = found->second.second;
+    const bool slower =
+        result.ops_per_sec < base_throughput * (1 - options.tolerance);
+    const bool laggier = base_p99 > 0 &&
+        result.p99_ns > base_p99 * (1 + options.latency_tolerance);
+    if (slower || laggier) {
+      result.regression = true;
+      ++regressions;
+      std::cerr << "REGRESSION " << ResultKey(ParamColumns(result))
+                << " ops/sec " << FormatDouble(base_throughput, 0) << " -> "
+                << FormatDouble(result.ops_per_sec, 0) << ", p99 ns "
+                << FormatDouble(base_p99, 0) << " -> "
+                << FormatDouble(result.p99_ns, 0) << std::endl;
+    }
+  }
+  return regressions;
+}
+
+// Ускорение относительно минимального числа потоков при тех же
+// остальных параметрах - это и есть кривая масштабируемости.
+void ComputeSpeedup(std::vector<Result>& results) {
+  std::map<std::string, const Result*> base;
+  for (const Result& result : results) {
+    std::vector<std::string> columns = ParamColumns(result);
+    columns[1].clear();
+    const std::string key = ResultKey(columns);
+    const auto found = base.find(key);
+    if (found == base.end() ||
+        found->second->params.threads > result.params.threads) {
+      base[key] = &result;
+    }
+  }
+  for (Result& result : results) {
+    std::vector<std::string> columns = ParamColumns(result);
+    columns[1].clear();
+    const Result* reference = base[ResultKey(columns)];
+    result.speedup = reference->ops_per_sec > 0
+        ? result.ops_per_sec / reference->ops_per_sec : 0;
+  }
+}
+
+}  // namespace
+
+///////////////////////////////////////////////////////////////////////
+
+KeyGenerator::KeyGenerator(const Params& params, const uint64_t seed)
+    : distribution_(params.distribution),
+      key_range_(std::max<uint64_t>(params.key_range, 1)),
+      random_(seed),
+      unit_(0.0, 1.0),
+      theta_(params.zipf_theta),
+      zeta_n_(0),
+      alpha_(0),
+      eta_(0) {
+  if (distribution_ != KeyDistribution::kZipf) {
+    return;
+  }
+  // zeta(n) считается за O(n), поэтому кэшируем ее между потоками.
+  static std::mutex cache_mutex;
+  static std::map<std::pair<uint64_t, double>, double> zeta_cache;
+  {
+    std::lock_guard<std::mutex> locker(cache_mutex);
+    auto found = zeta_cache.find({key_range_, theta_});
+    if (found == zeta_cache.end()) {
+      double zeta = 0;
+      for (uint64_t i = 1; i <= key_range_; ++i) {
+        zeta += 1.0 / std::pow(static_cast<double>(i), theta_);
+      }
+      found = zeta_cache.emplace(std::make_pair(key_range_, theta_), zeta)
+          .first;
+    }
+    zeta_n_ = found->second;
+  }
+  const double zeta_2 = 1.0 + 1.0 / std::pow(2.0, theta_);
+  alpha_ = 1.0 / (1.0 - theta_);
+  eta_ = (1.0 - std::pow(2.0 / static_cast<double>(key_range_),
+                         1.0 - theta_)) /
+      (1.0 - zeta_2 / zeta_n_);
+}
+
+uint64_t KeyGenerator::Next() {
+  if (distribution_ == KeyDistribution::kUniform) {
+    return random_() % key_range_;
+  }
+  // Перемешиваем ранг (splitmix64), чтобы популярные ключи были
+  // разбросаны по таблице.
+  uint64_t key = NextZipfRank() + 0x9e3779b97f4a7c15ULL;
+  key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+  return (key ^ (key >> 31)) % key_range_;
+}
+
+uint64_t KeyGenerator::NextZipfRank() {
+  const double u = unit_(random_);
+  const double uz = u * zeta_n_;
+  if (uz < 1.0) {
+    return 0;
+  }
+  if (uz < 1.0 + std::pow(0.5, theta_)) {
+    return 1;
+  }
+  const uint64_t rank = static_cast<uint64_t>(
+      static_cast<double>(key_range_) *
+      std::pow(eta_ * u - eta_ + 1.0, alpha_));
+  return std::min(rank, key_range_ - 1);
+}
+
+ThreadContext::ThreadContext(const Params& params, const size_t index)
+    : index_(index),
+      threads_(params.threads),
+      read_ratio_(params.read_ratio),
+      random_(0x5eed + index),
+      unit_(0.0, 1.0),
+      keys_(params, 0x6b65 + index * 7919) {}
+
+void Register(const std::string& name, const unsigned axes,
+              WorkloadFactory factory) {
+  Registry().push_back({name, axes, std::move(factory)});
+}
+
+}  // namespace bench
+
+int main(int argc, char** argv) {
+  using namespace bench;
+  const Options options = ParseOptions(argc, argv);
+  std::vector<Benchmark> benchmarks = Registry();
+  std::sort(benchmarks.begin(), benchmarks.end(),
+            [](const Benchmark& left, const Benchmark& right) {
+              return left.name < right.name;
+            });
+
+  if (options.list) {
+    for (const Benchmark& benchmark : benchmarks) {
+      std::cout << benchmark.name << "\n";
+    }
+    return 0;
+  }
+
+  std::vector<Result> results;
+  for (const Benchmark& benchmark : benchmarks) {
+    if (benchmark.name.find(options.filter) == std::string::npos) {
+      continue;
+    }
+    for (const Params& params : Sweep(benchmark, options)) {
+      results.push_back(RunPoint(benchmark, params, options));
+    }
+  }
+  ComputeSpeedup(results);
+  const size_t regressions =
+      options.baseline.empty() ? 0 : CompareWithBaseline(results, options);
+
+  std::ofstream file;
+  if (!options.output.empty()) {
+    file.open(options.output);
+    if (!file) {
+      std::cerr << "cannot write " << options.output << std::endl;
+      return 1;
+    }
+  }
+  std::ostream& out = options.output.empty() ? std::cout : file;
+  switch (options.format) {
+    case Format::kTable:
+      WriteTable(out, results);
+      break;
+    case Format::kCsv:
+      WriteCsv(out, results);
+      break;
+    case Format::kJson:
+      WriteJson(out, results);
+      break;
+  }
+  if (lock_profiler::Enabled()) {
+    lock_profiler::PrintReport(std::cerr);
+  }
+  return regressions == 0 ? 0 : 2;
+}
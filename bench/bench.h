@@ -0,0 +1,170 @@
+#pragma once
+
+// Общий каркас микробенчмарков.
+// Провилков Иван. гр.593.
+//
+// Каждый бенчмарк регистрирует фабрику Workload, а каркас перебирает
+// параметры (число потоков, доля чтений, распределение ключей,
+// вместимость очереди), запускает потоки, считает пропускную способность
+// и перцентили задержки и печатает результат в виде таблицы, CSV или
+// JSON. С --baseline сравнивает результат с сохраненным CSV и
+// возвращает ненулевой код при регрессии.
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bench {
+
+enum class KeyDistribution {
+  kUniform,
+  kZipf,
+};
+
+// Какие из параметров важны бенчмарку. По остальным осям каркас не
+// перебирает значения.
+enum Axis : unsigned {
+  kThreadsAxis = 1u << 0,
+  kReadRatioAxis = 1u << 1,
+  kDistributionAxis = 1u << 2,
+  kCapacityAxis = 1u << 3,
+};
+
+struct Params {
+  size_t threads = 1;
+  // Доля операций чтения, от 0 до 1.
+  double read_ratio = 0.0;
+  KeyDistribution distribution = KeyDistribution::kUniform;
+  // Вместимость очереди.
+  size_t capacity = 0;
+  // Ключи берутся из [0, key_range).
+  size_t key_range = 0;
+  double zipf_theta = 0.99;
+};
+
+// Генератор ключей: равномерный или по закону Ципфа (алгоритм из YCSB).
+// Самые популярные ключи перемешиваются, чтобы не попадать все в
+// соседние корзины и полосы хэш-таблиц.
+class KeyGenerator {
+ public:
+  KeyGenerator(const Params& params, uint64_t seed);
+
+  uint64_t Next();
+
+ private:
+  uint64_t NextZipfRank();
+
+  KeyDistribution distribution_;
+  uint64_t key_range_;
+  std::mt19937_64 random_;
+  std::uniform_real_distribution<double> unit_;
+  double theta_;
+  double zeta_n_;
+  double alpha_;
+  double eta_;
+};
+
+// Состояние одного потока бенчмарка.
+class ThreadContext {
+ public:
+  ThreadContext(const Params& params, size_t index);
+
+  size_t Index() const {
+    return index_;
+  }
+
+  size_t Threads() const {
+    return threads_;
+  }
+
+  // true с вероятностью read_ratio.
+  bool NextIsRead() {
+    return unit_(random_) < read_ratio_;
+  }
+
+  uint64_t NextKey() {
+    return keys_.Next();
+  }
+
+  std::mt19937_64& Random() {
+    return random_;
+  }
+
+ private:
+  size_t index_;
+  size_t threads_;
+  double read_ratio_;
+  std::mt19937_64 random_;
+  std::uniform_real_distribution<double> unit_;
+  KeyGenerator keys_;
+};
+
+// Нагрузка, которую потоки выполняют в цикле.
+class Workload {
+ public:
+  virtual ~Workload() = default;
+
+  // Одна операция. Ее задержку и меряет каркас.
+  virtual void Operation(ThreadContext& context) = 0;
+
+  // Вызывается после того, как выставлен флаг остановки: здесь нужно
+  // разбудить потоки, заблокированные внутри Operation (например,
+  // сделать Shutdown очереди).
+  virtual void Stop() {}
+
+  // Если не 0, каждый поток делает ровно столько операций, а не крутится
+  // до конца отведенного времени. Нужно примитивам, где все потоки
+  // должны сделать одинаковое число шагов (барьеры).
+  virtual uint64_t FixedOperationsPerThread() const {
+    return 0;
+  }
+
+  // true, если threads - это число рабочих внутри самого примитива (пул
+  // параллельных алгоритмов), а операции подает один поток бенчмарка.
+  virtual bool SingleClient() const {
+    return false;
+  }
+};
+
+// Фабрика может поправить параметры под себя (например, уменьшить
+// диапазон ключей), потоки получат уже исправленные.
+using WorkloadFactory = std::function<std::unique_ptr<Workload>(Params&)>;
+
+// Нагрузка из лямбды. state держит объекты, которые делят потоки.
+template <class State, class Body>
+class LambdaWorkload : public Workload {
+ public:
+  LambdaWorkload(std::shared_ptr<State> state, Body body)
+      : state_(std::move(state)), body_(std::move(body)) {}
+
+  void Operation(ThreadContext& context) override {
+    body_(*state_, context);
+  }
+
+ private:
+  std::shared_ptr<State> state_;
+  Body body_;
+};
+
+template <class State, class Body>
+std::unique_ptr<Workload> MakeWorkload(std::shared_ptr<State> state,
+                                       Body body) {
+  return std::make_unique<LambdaWorkload<State, Body>>(std::move(state),
+                                                       std::move(body));
+}
+
+void Register(const std::string& name, unsigned axes, WorkloadFactory factory);
+
+// Регистрация бенчмарка статическим объектом в файле бенчмарка.
+struct Registrar {
+  Registrar(const std::string& name, const unsigned axes,
+            WorkloadFactory factory) {
+    Register(name, axes, std::move(factory));
+  }
+};
+
+}  // namespace bench
@@ -0,0 +1,98 @@
+// ConcurrentCache из task-4-A против LRU под одним мьютексом, как кэш
+// был устроен раньше. Чтение - GetOrLoad (промах загружает ключ), запись
+// - Put. Кэш вмещает четверть ключей, так что вытеснение идет все время;
+// с распределением Ципфа горячие ключи остаются в кэше.
+// Провилков Иван. гр.593.
+
+#include "bench.h"
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#include "../task-4-A/task-4-A(Concurrent cache).h"
+
+namespace {
+
+// Сколько байт занимает запись по CacheDefaultWeigher.
+constexpr size_t kEntryBytes = sizeof(uint64_t) * 2;
+
+class GlobalLockLru {
+ public:
+  explicit GlobalLockLru(size_t capacity) : capacity_(capacity) {}
+
+  template <class Loader>
+  uint64_t GetOrLoad(uint64_t key, Loader loader) {
+    std::lock_guard<std::mutex> locker(mutex_);
+    auto found = index_.find(key);
+    if (found != index_.end()) {
+      order_.splice(order_.begin(), order_, found->second);
+      return found->second->second;
+    }
+    const uint64_t value = loader();
+    Store(key, value);
+    return value;
+  }
+
+  void Put(uint64_t key, uint64_t value) {
+    std::lock_guard<std::mutex> locker(mutex_);
+    auto found = index_.find(key);
+    if (found != index_.end()) {
+      order_.erase(found->second);
+      index_.erase(found);
+    }
+    Store(key, value);
+  }
+
+ private:
+  void Store(uint64_t key, uint64_t value) {
+    if (index_.size() >= capacity_) {
+      index_.erase(order_.back().first);
+      order_.pop_back();
+    }
+    order_.emplace_front(key, value);
+    index_.emplace(key, order_.begin());
+  }
+
+  std::mutex mutex_;
+  size_t capacity_;
+  std::list<std::pair<uint64_t, uint64_t> > order_;
+  std::unordered_map<uint64_t,
+                     std::list<std::pair<uint64_t, uint64_t> >::iterator>
+      index_;
+};
+
+template <class Cache>
+void CacheOperation(Cache& cache, bench::ThreadContext& context) {
+  const uint64_t key = context.NextKey();
+  if (context.NextIsRead()) {
+    volatile uint64_t value = cache.GetOrLoad(key, [key]() {
+      return key * 2654435761u;
+    });
+    (void)value;
+  } else {
+    cache.Put(key, key);
+  }
+}
+
+bench::Registrar global_lock_lru(
+    "cache/GlobalLockLru",
+    bench::kThreadsAxis | bench::kReadRatioAxis | bench::kDistributionAxis,
+    [](const bench::Params& params) {
+      return bench::MakeWorkload(
+          std::make_shared<GlobalLockLru>(params.key_range / 4),
+          CacheOperation<GlobalLockLru>);
+    });
+
+bench::Registrar concurrent_cache(
+    "cache/ConcurrentCache",
+    bench::kThreadsAxis | bench::kReadRatioAxis | bench::kDistributionAxis,
+    [](const bench::Params& params) {
+      using Cache = ConcurrentCache<uint64_t, uint64_t>;
+      return bench::MakeWorkload(
+          std::make_shared<Cache>(params.key_range / 4 * kEntryBytes,
+                                  std::max<size_t>(params.threads * 4, 16)),
+          CacheOperation<Cache>);
+    });
+
+}  // namespace
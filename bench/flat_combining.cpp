@@ -0,0 +1,64 @@
+// Flat combining: BlockingQueue и StripedHashSet за FlatCombiner. Для
+// сравнения те же нагрузки без комбинирования - queue/BlockingQueue и
+// set/StripedHashSet; разница видна при многих потоках и распределении
+// Ципфа, когда все бьют в один объект (горячую полосу).
+// Провилков Иван. гр.593.
+
+#include "set_workload.h"
+
+#include "../flat_combining.h"
+#include "../task-3-A/task-3-A(Блокирующая очередь).h"
+#include "../task-4-A/task-4-A(Striped Hash Set).h"
+
+namespace {
+
+class ProducerConsumer : public bench::Workload {
+ public:
+  explicit ProducerConsumer(const bench::Params& params)
+      : queue_(std::max<size_t>(params.capacity, 1)),
+        threads_(params.threads) {}
+
+  void Operation(bench::ThreadContext& context) override {
+    try {
+      if (threads_ == 1) {
+        int value = 0;
+        queue_.Put(static_cast<int>(context.NextKey()));
+        queue_.Get(value);
+      } else if (context.Index() % 2 == 0) {
+        queue_.Put(static_cast<int>(context.NextKey()));
+      } else {
+        int value = 0;
+        queue_.Get(value);
+      }
+    } catch (const BlockingQueueException&) {
+      // Очередь закрыта в Stop, прогон заканчивается.
+    }
+  }
+
+  void Stop() override {
+    queue_.Shutdown();
+  }
+
+ private:
+  FlatCombiningQueue<int, BlockingQueue> queue_;
+  size_t threads_;
+};
+
+bench::Registrar producer_consumer(
+    "fc/BlockingQueue", bench::kThreadsAxis | bench::kCapacityAxis,
+    [](const bench::Params& params) {
+      return std::make_unique<ProducerConsumer>(params);
+    });
+
+// Комбинатор на каждую полосу.
+bench::Registrar striped_set(
+    "fc/StripedHashSet",
+    bench::kThreadsAxis | bench::kReadRatioAxis | bench::kDistributionAxis,
+    bench::SetWorkload<FlatCombiningSet<int, StripedHashSet> >(
+        [](const bench::Params& params) {
+      const size_t stripes = std::max<size_t>(params.threads * 4, 16);
+      return std::make_shared<FlatCombiningSet<int, StripedHashSet> >(
+          stripes, stripes);
+    }));
+
+}  // namespace
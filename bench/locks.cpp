@@ -0,0 +1,81 @@
+// Взаимные исключения: ticket_spinlock, SpinLock, TreeMutex,
+// FastTreeMutex и std::mutex.
+// Провилков Иван. гр.593.
+
+#include "bench.h"
+
+#include <mutex>
+#include <thread>
+
+#include "../task-1-C.cpp"
+#include "../task-1-E/task-1-E.h"
+#include "../task-4-B/task-4-B(Optimistic list).h"
+
+namespace {
+
+// Короткая критическая секция: счетчик и немного данных на соседних
+// кэш-линиях, как в типичной защищенной структуре.
+struct SharedData {
+  static constexpr size_t kWords = 16;
+
+  uint64_t counter = 0;
+  uint64_t words[kWords] = {};
+
+  void Touch(const uint64_t key) {
+    ++counter;
+    words[key % kWords] += key;
+  }
+};
+
+// Мьютексы с интерфейсом lock()/unlock().
+template <class Mutex>
+bench::WorkloadFactory BasicLockable() {
+  struct State {
+    Mutex mutex;
+    SharedData data;
+  };
+  return [](const bench::Params&) {
+    return bench::MakeWorkload(
+        std::make_shared<State>(),
+        [](State& state, bench::ThreadContext& context) {
+          const uint64_t key = context.NextKey();
+          std::lock_guard<Mutex> locker(state.mutex);
+          state.data.Touch(key);
+        });
+  };
+}
+
+// Мьютексы турнирного дерева, которым нужен номер потока.
+template <class Mutex>
+bench::WorkloadFactory IndexedLockable() {
+  struct State {
+    explicit State(const size_t threads)
+        : mutex(static_cast<int>(threads)) {}
+    Mutex mutex;
+    SharedData data;
+  };
+  return [](const bench::Params& params) {
+    return bench::MakeWorkload(
+        std::make_shared<State>(params.threads),
+        [](State& state, bench::ThreadContext& context) {
+          const uint64_t key = context.NextKey();
+          const int index = static_cast<int>(context.Index());
+          state.mutex.Lock(index);
+          state.data.Touch(key);
+          state.mutex.Unlock(index);
+        });
+  };
+}
+
+bench::Registrar std_mutex("mutex/std::mutex", bench::kThreadsAxis,
+                           BasicLockable<std::mutex>());
+bench::Registrar ticket("mutex/ticket_spinlock", bench::kThreadsAxis,
+                        BasicLockable<ticket_spinlock>());
+bench::Registrar spin_lock("mutex/SpinLock", bench::kThreadsAxis,
+                           BasicLockable<SpinLock>());
+bench::Registrar tree("mutex/TreeMutex", bench::kThreadsAxis,
+                      IndexedLockable<TreeMutex>());
+bench::Registrar fast_tree("mutex/FastTreeMutex", bench::kThreadsAxis,
+                           IndexedLockable<FastTreeMutex>());
+
+}  // namespace
@@ -0,0 +1,51 @@
+// OptimisticLinkedSet из task-4-B.
+// Провилков Иван. гр.593.
+
+#include "set_workload.h"
+
+#include <thread>
+
+#include "../task-4-B/task-4-B(Optimistic list).h"
+
+namespace {
+
+// Список линейный, поэтому ключей берем не больше kMaxKeys.
+constexpr size_t kMaxKeys = 1024;
+
+class ListWithArena {
+ public:
+  ListWithArena()
+      : list_(allocator_) {}
+
+  bool Insert(const int element) {
+    return list_.Insert(element);
+  }
+
+  bool Remove(const int element) {
+    return list_.Remove(element);
+  }
+
+  bool Contains(const int element) const {
+    return list_.Contains(element);
+  }
+
+ private:
+  ArenaAllocator allocator_;
+  OptimisticLinkedSet<int> list_;
+};
+
+bench::WorkloadFactory ListWorkload() {
+  auto factory = bench::SetWorkload<ListWithArena>(
+      [](const bench::Params&) { return std::make_shared<ListWithArena>(); });
+  return [factory](bench::Params& params) {
+    params.key_range = std::min(params.key_range, kMaxKeys);
+    return factory(params);
+  };
+}
+
+bench::Registrar optimistic_list(
+    "set/OptimisticLinkedSet",
+    bench::kThreadsAxis | bench::kReadRatioAxis | bench::kDistributionAxis,
+    ListWorkload());
+
+}  // namespace
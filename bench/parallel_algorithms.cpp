@@ -0,0 +1,93 @@
+// Параллельные алгоритмы из task-3-B. Ось threads здесь - размер пула,
+// операции подает один поток, так что speedup показывает
+// масштабируемость самих алгоритмов.
+// Провилков Иван. гр.593.
+
+#include "bench.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+
+#include "../task-3-B/task-3-B(Параллельные алгоритмы).h"
+
+namespace {
+
+constexpr size_t kElements = 1 << 20;
+
+struct Data {
+  explicit Data(size_t workers) : pool(workers), input(kElements),
+                                  output(kElements) {
+    std::mt19937_64 random(7);
+    for (uint64_t& value : input) {
+      value = random();
+    }
+  }
+
+  ThreadPool<void> pool;
+  std::vector<uint64_t> input;
+  std::vector<uint64_t> output;
+};
+
+template <class Body>
+class AlgorithmWorkload : public bench::Workload {
+ public:
+  AlgorithmWorkload(size_t workers, Body body)
+      : data_(workers), body_(std::move(body)) {}
+
+  void Operation(bench::ThreadContext&) override {
+    body_(data_);
+  }
+
+  bool SingleClient() const override {
+    return true;
+  }
+
+ private:
+  Data data_;
+  Body body_;
+};
+
+template <class Body>
+bench::WorkloadFactory Algorithm(Body body) {
+  return [body](const bench::Params& params) {
+    return std::make_unique<AlgorithmWorkload<Body>>(params.threads, body);
+  };
+}
+
+bench::Registrar parallel_for(
+    "parallel/for", bench::kThreadsAxis, Algorithm([](Data& data) {
+      ParallelFor(data.pool, 0, kElements, [&data](size_t i) {
+        data.output[i] = data.input[i] * 2654435761u + (data.input[i] >> 7);
+      });
+    }));
+
+bench::Registrar parallel_transform(
+    "parallel/transform", bench::kThreadsAxis, Algorithm([](Data& data) {
+      ParallelTransform(data.pool, data.input.begin(), data.input.end(),
+                        data.output.begin(), [](uint64_t value) {
+        return static_cast<uint64_t>(std::sqrt(static_cast<double>(value)));
+      });
+    }));
+
+bench::Registrar parallel_reduce(
+    "parallel/reduce", bench::kThreadsAxis, Algorithm([](Data& data) {
+      volatile uint64_t sum = ParallelReduce(data.pool, data.input.begin(),
+                                             data.input.end(), uint64_t(0));
+      (void)sum;
+    }));
+
+bench::Registrar parallel_scan(
+    "parallel/inclusive_scan", bench::kThreadsAxis, Algorithm([](Data& data) {
+      ParallelInclusiveScan(data.pool, data.input.begin(), data.input.end(),
+                            data.output.begin());
+    }));
+
+bench::Registrar parallel_sort(
+    "parallel/sort", bench::kThreadsAxis, Algorithm([](Data& data) {
+      std::copy(data.input.begin(), data.input.end(), data.output.begin());
+      ParallelSort(data.pool, data.output.begin(), data.output.end());
+    }));
+
+}  // namespace
@@ -0,0 +1,145 @@
+// Конвейер из task-3-A против цепочки потоков, соединенных
+// BlockingQueue вручную. Операцию - Push одного элемента - подает один
+// поток; из-за ограниченных связей пропускная способность в
+// установившемся режиме равна пропускной способности всего конвейера.
+// Провилков Иван. гр.593.
+
+#include "bench.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "../task-3-A/task-3-A(Конвейер).h"
+
+namespace {
+
+uint64_t Mix(uint64_t value) {
+  value ^= value >> 33;
+  value *= 0xff51afd7ed558ccdull;
+  value ^= value >> 33;
+  return value;
+}
+
+// Две стадии и сток, как их соединяли до конвейера: поток на стадию и
+// BlockingQueue между ними.
+class HandChained : public bench::Workload {
+ public:
+  explicit HandChained(const bench::Params& params)
+      : first_(std::max<size_t>(params.capacity, 1)),
+        second_(std::max<size_t>(params.capacity, 1)),
+        third_(std::max<size_t>(params.capacity, 1)) {
+    threads_.emplace_back([this]() {
+      Forward(first_, second_);
+    });
+    threads_.emplace_back([this]() {
+      Forward(second_, third_);
+    });
+    threads_.emplace_back([this]() {
+      uint64_t value = 0;
+      while (third_.Get(value)) {
+        sum_ += value;
+      }
+    });
+  }
+
+  ~HandChained() override {
+    first_.Shutdown();
+    for (std::thread& thread : threads_) {
+      thread.join();
+    }
+  }
+
+  void Operation(bench::ThreadContext& context) override {
+    try {
+      first_.Put(context.NextKey());
+    } catch (const BlockingQueueException&) {
+      // Очередь закрыта в Stop, прогон заканчивается.
+    }
+  }
+
+  void Stop() override {
+    first_.Shutdown();
+  }
+
+  bool SingleClient() const override {
+    return true;
+  }
+
+ private:
+  static void Forward(BlockingQueue<uint64_t>& input,
+                      BlockingQueue<uint64_t>& output) {
+    uint64_t value = 0;
+    while (input.Get(value)) {
+      try {
+        output.Put(Mix(value));
+      } catch (const BlockingQueueException&) {
+        return;
+      }
+    }
+    output.Shutdown();
+  }
+
+  BlockingQueue<uint64_t> first_, second_, third_;
+  uint64_t sum_ = 0;
+  std::vector<std::thread> threads_;
+};
+
+bench::Registrar hand_chained(
+    "pipeline/hand_chained_blocking_queues", bench::kCapacityAxis,
+    [](const bench::Params& params) {
+      return std::make_unique<HandChained>(params);
+    });
+
+// То же через Pipeline: все связи 1:1, то есть кольцевые буферы.
+// С parallel вторая стадия выполняется threads потоками с сохранением
+// порядка, и ее связи становятся BlockingQueue.
+class PipelineWorkload : public bench::Workload {
+ public:
+  PipelineWorkload(const bench::Params& params, size_t parallelism)
+      : pipeline_(Build(params, parallelism)) {}
+
+  void Operation(bench::ThreadContext& context) override {
+    pipeline_.Push(context.NextKey());
+  }
+
+  void Stop() override {
+    pipeline_.Close();
+  }
+
+  bool SingleClient() const override {
+    return true;
+  }
+
+ private:
+  Pipeline<uint64_t> Build(const bench::Params& params, size_t parallelism) {
+    StageOptions link;
+    link.capacity = std::max<size_t>(params.capacity, 1);
+    StageOptions parallel = link;
+    parallel.parallelism = parallelism;
+    return PipelineBuilder<uint64_t>()
+        .Then(Mix, link)
+        .Then(Mix, parallel)
+        .Sink([this](uint64_t value) {
+          sum_ += value;
+        }, link);
+  }
+
+  uint64_t sum_ = 0;
+  Pipeline<uint64_t> pipeline_;
+};
+
+bench::Registrar spsc_chain(
+    "pipeline/spsc_chain", bench::kCapacityAxis,
+    [](const bench::Params& params) {
+      return std::make_unique<PipelineWorkload>(params, 1);
+    });
+
+bench::Registrar parallel_stage(
+    "pipeline/parallel_ordered_stage",
+    bench::kThreadsAxis | bench::kCapacityAxis,
+    [](const bench::Params& params) {
+      return std::make_unique<PipelineWorkload>(params, params.threads);
+    });
+
+}  // namespace
@@ -0,0 +1,86 @@
+// Очереди из task-3-A: BlockingQueue (deque под мьютексом) и
+// неограниченная lock-free BlockingSegmentedQueue.
+// Провилков Иван. гр.593.
+
+#include "bench.h"
+
+#include "../task-3-A/task-3-A(Блокирующая очередь).h"
+#include "../task-3-A/task-3-A(Сегментная очередь).h"
+
+namespace {
+
+// Половина потоков кладет, половина забирает. Один поток делает и то,
+// и другое по очереди.
+class ProducerConsumer : public bench::Workload {
+ public:
+  explicit ProducerConsumer(const bench::Params& params)
+      : queue_(std::max<size_t>(params.capacity, 1)),
+        threads_(params.threads) {}
+
+  void Operation(bench::ThreadContext& context) override {
+    try {
+      if (threads_ == 1) {
+        int value = 0;
+        queue_.Put(static_cast<int>(context.NextKey()));
+        queue_.Get(value);
+      } else if (context.Index() % 2 == 0) {
+        queue_.Put(static_cast<int>(context.NextKey()));
+      } else {
+        int value = 0;
+        queue_.Get(value);
+      }
+    } catch (const BlockingQueueException&) {
+      // Очередь закрыта в Stop, прогон заканчивается.
+    }
+  }
+
+  void Stop() override {
+    queue_.Shutdown();
+  }
+
+ private:
+  BlockingQueue<int> queue_;
+  size_t threads_;
+};
+
+bench::Registrar producer_consumer(
+    "queue/BlockingQueue", bench::kThreadsAxis | bench::kCapacityAxis,
+    [](const bench::Params& params) {
+      return std::make_unique<ProducerConsumer>(params);
+    });
+
+// То же для неограниченной очереди: вместимость не важна, потребители
+// не ждут места, так что меряется чистая пропускная способность.
+class SegmentedProducerConsumer : public bench::Workload {
+ public:
+  explicit SegmentedProducerConsumer(const bench::Params& params)
+      : threads_(params.threads) {}
+
+  void Operation(bench::ThreadContext& context) override {
+    int value = 0;
+    if (threads_ == 1) {
+      queue_.Put(static_cast<int>(context.NextKey()));
+      queue_.Get(value);
+    } else if (context.Index() % 2 == 0) {
+      queue_.Put(static_cast<int>(context.NextKey()));
+    } else {
+      queue_.Get(value);
+    }
+  }
+
+  void Stop() override {
+    queue_.Shutdown();
+  }
+
+ private:
+  BlockingSegmentedQueue<int> queue_;
+  size_t threads_;
+};
+
+bench::Registrar segmented_producer_consumer(
+    "queue/BlockingSegmentedQueue", bench::kThreadsAxis,
+    [](const bench::Params& params) {
+      return std::make_unique<SegmentedProducerConsumer>(params);
+    });
+
+}  // namespace
@@ -0,0 +1,45 @@
+// Reader-writer мьютексы: RWMutex и std::shared_mutex.
+// Провилков Иван. гр.593.
+
+#include "bench.h"
+
+#include <mutex>
+#include <shared_mutex>
+
+#include "../task-4-A/task-4-A(RWMutex).h"
+
+namespace {
+
+constexpr size_t kWords = 64;
+
+template <class Mutex>
+bench::WorkloadFactory SharedLockable() {
+  struct State {
+    Mutex mutex;
+    uint64_t words[kWords] = {};
+  };
+  return [](const bench::Params&) {
+    return bench::MakeWorkload(
+        std::make_shared<State>(),
+        [](State& state, bench::ThreadContext& context) {
+          const uint64_t key = context.NextKey();
+          if (context.NextIsRead()) {
+            std::shared_lock<Mutex> locker(state.mutex);
+            volatile uint64_t sink = state.words[key % kWords];
+            (void)sink;
+          } else {
+            std::unique_lock<Mutex> locker(state.mutex);
+            state.words[key % kWords] += key;
+          }
+        });
+  };
+}
+
+bench::Registrar rw_mutex("rwmutex/RWMutex",
+                          bench::kThreadsAxis | bench::kReadRatioAxis,
+                          SharedLockable<RWMutex>());
+bench::Registrar shared_mutex("rwmutex/std::shared_mutex",
+                              bench::kThreadsAxis | bench::kReadRatioAxis,
+                              SharedLockable<std::shared_mutex>());
+
+}  // namespace
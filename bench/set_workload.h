@@ -0,0 +1,39 @@
+#pragma once
+
+// Общая нагрузка для множеств: Contains с долей read_ratio, остальное
+// поровну Insert и Remove. Перед прогоном множество заполняется
+// наполовину.
+// Провилков Иван. гр.593.
+
+#include "bench.h"
+
+#include <memory>
+#include <utility>
+
+namespace bench {
+
+template <class Set, class MakeSet>
+WorkloadFactory SetWorkload(MakeSet make_set) {
+  return [make_set](Params& params) {
+    std::shared_ptr<Set> set = make_set(params);
+    Params fill = params;
+    fill.distribution = KeyDistribution::kUniform;
+    KeyGenerator keys(fill, 0xfeed);
+    for (size_t i = 0; i < params.key_range / 2; ++i) {
+      set->Insert(static_cast<int>(keys.Next()));
+    }
+    return MakeWorkload(std::move(set), [](Set& set, ThreadContext& context) {
+      const int key = static_cast<int>(context.NextKey());
+      if (context.NextIsRead()) {
+        volatile bool found = set.Contains(key);
+        (void)found;
+      } else if (context.Random()() % 2 == 0) {
+        set.Insert(key);
+      } else {
+        set.Remove(key);
+      }
+    });
+  };
+}
+
+}  // namespace bench
@@ -0,0 +1,94 @@
+// Перезапуск StripedHashSet: сколько стоит получить заполненное множество
+// заново вставкой всех элементов, загрузкой снимка (LoadSnapshot) и
+// отображением снимка (MappedSnapshot, поиск прямо по файлу). Отдельно -
+// стоимость самого SaveSnapshot. Одна операция - целое множество.
+// Провилков Иван. гр.593.
+
+#include "bench.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "../task-4-A/task-4-A(Striped Hash Set).h"
+
+namespace {
+
+constexpr size_t kElements = 1 << 18;
+constexpr size_t kConcurrencyLevel = 16;
+
+using Set = StripedHashSet<uint64_t>;
+
+struct Data {
+  Data() : set(kConcurrencyLevel),
+           path((std::filesystem::temp_directory_path() /
+                 ("bench_snapshot_" + std::to_string(getpid()))).string()) {
+    std::mt19937_64 random(7);
+    for (size_t i = 0; i < kElements; ++i) {
+      elements.push_back(random());
+      set.Insert(elements.back());
+    }
+    set.SaveSnapshot(path);
+  }
+
+  ~Data() {
+    std::filesystem::remove(path);
+  }
+
+  std::vector<uint64_t> elements;
+  Set set;
+  std::string path;
+};
+
+template <class Body>
+class RestartWorkload : public bench::Workload {
+ public:
+  explicit RestartWorkload(Body body) : body_(std::move(body)) {}
+
+  void Operation(bench::ThreadContext&) override {
+    body_(data_);
+  }
+
+  bool SingleClient() const override {
+    return true;
+  }
+
+ private:
+  Data data_;
+  Body body_;
+};
+
+template <class Body>
+bench::WorkloadFactory Restart(Body body) {
+  return [body](const bench::Params&) {
+    return std::make_unique<RestartWorkload<Body>>(body);
+  };
+}
+
+bench::Registrar reinsert("snapshot/reinsert", 0, Restart([](Data& data) {
+  Set set(kConcurrencyLevel);
+  for (uint64_t element : data.elements) {
+    set.Insert(element);
+  }
+}));
+
+bench::Registrar load("snapshot/load", 0, Restart([](Data& data) {
+  Set set(kConcurrencyLevel);
+  set.LoadSnapshot(data.path);
+}));
+
+bench::Registrar mapped("snapshot/mapped", 0, Restart([](Data& data) {
+  MappedSnapshot<uint64_t> snapshot(data.path);
+  volatile bool found = snapshot.Contains(data.elements.front());
+  (void)found;
+}));
+
+bench::Registrar save("snapshot/save", 0, Restart([](Data& data) {
+  data.set.SaveSnapshot(data.path);
+}));
+
+}  // namespace
@@ -0,0 +1,18 @@
+// StripedHashSet на std::mutex.
+// Провилков Иван. гр.593.
+
+#include "set_workload.h"
+
+#include "../task-4-A/task-4-A(Striped Hash Set).h"
+
+namespace {
+
+bench::Registrar striped_set(
+    "set/StripedHashSet",
+    bench::kThreadsAxis | bench::kReadRatioAxis | bench::kDistributionAxis,
+    bench::SetWorkload<StripedHashSet<int>>([](const bench::Params& params) {
+      return std::make_shared<StripedHashSet<int>>(
+          std::max<size_t>(params.threads * 4, 16));
+    }));
+
+}  // namespace
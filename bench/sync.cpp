@@ -0,0 +1,111 @@
+// Барьеры и семафор.
+// Провилков Иван. гр.593.
+
+#include "bench.h"
+
+#include "../task-2-A/task-2-A.h"
+#include "../task-2-A/task-2-A(Phaser).h"
+#include "../task-2-A/task-2-A(Спиннинг барьеры).h"
+#include "../task-2-B/task-2-B(счетный семафор).h"
+
+namespace {
+
+// Все потоки должны пройти барьер одинаковое число раз.
+constexpr uint64_t kCrossings = 2000;
+
+template <class State, class Body>
+class CrossingsWorkload : public bench::Workload {
+ public:
+  CrossingsWorkload(std::shared_ptr<State> state, Body body)
+      : state_(std::move(state)), body_(std::move(body)) {}
+
+  void Operation(bench::ThreadContext& context) override {
+    body_(*state_, context);
+  }
+
+  uint64_t FixedOperationsPerThread() const override {
+    return kCrossings;
+  }
+
+ private:
+  std::shared_ptr<State> state_;
+  Body body_;
+};
+
+template <class State, class Body>
+std::unique_ptr<bench::Workload> MakeCrossings(std::shared_ptr<State> state,
+                                               Body body) {
+  return std::make_unique<CrossingsWorkload<State, Body>>(std::move(state),
+                                                          std::move(body));
+}
+
+bench::Registrar cyclic(
+    "barrier/CyclicBarrier", bench::kThreadsAxis,
+    [](const bench::Params& params) {
+      using Barrier = CyclicBarrier<>;
+      return MakeCrossings(
+          std::make_shared<Barrier>(static_cast<int64_t>(params.threads)),
+          [](Barrier& barrier, bench::ThreadContext&) { barrier.Pass(); });
+    });
+
+template <class Policy>
+bench::WorkloadFactory Spinning() {
+  return [](const bench::Params& params) {
+    using Barrier = SpinningBarrier<Policy>;
+    return MakeCrossings(
+        std::make_shared<Barrier>(params.threads),
+        [](Barrier& barrier, bench::ThreadContext& context) {
+          barrier.ArriveAndWait(context.Index());
+        });
+  };
+}
+
+bench::Registrar central("barrier/central", bench::kThreadsAxis,
+                         Spinning<CentralBarrierPolicy>());
+bench::Registrar combining_tree("barrier/combining_tree",
+                                bench::kThreadsAxis,
+                                Spinning<CombiningTreeBarrierPolicy>());
+bench::Registrar dissemination("barrier/dissemination", bench::kThreadsAxis,
+                               Spinning<DisseminationBarrierPolicy>());
+
+bench::Registrar split_phase(
+    "barrier/SplitPhaseBarrier", bench::kThreadsAxis,
+    [](const bench::Params& params) {
+      return MakeCrossings(
+          std::make_shared<SplitPhaseBarrier>(
+              static_cast<uint32_t>(params.threads)),
+          [](SplitPhaseBarrier& barrier, bench::ThreadContext&) {
+            barrier.Wait(barrier.Arrive());
+          });
+    });
+
+bench::Registrar phaser(
+    "barrier/Phaser", bench::kThreadsAxis, [](const bench::Params& params) {
+      return MakeCrossings(
+          std::make_shared<Phaser>(static_cast<uint32_t>(params.threads)),
+          [](Phaser& phaser, bench::ThreadContext&) {
+            phaser.ArriveAndAwaitAdvance();
+          });
+    });
+
+// Жетон ходит по кольцу потоков, как в многоножке из task-2-B.
+bench::Registrar semaphore_ring(
+    "semaphore/token_ring", bench::kThreadsAxis,
+    [](const bench::Params& params) {
+      struct Ring {
+        explicit Ring(const size_t size)
+            : semaphores(size) {
+          semaphores.front().Signal();
+        }
+        std::vector<Semaphore> semaphores;
+      };
+      return MakeCrossings(
+          std::make_shared<Ring>(params.threads),
+          [](Ring& ring, bench::ThreadContext& context) {
+            const size_t index = context.Index();
+            ring.semaphores[index].Wait();
+            ring.semaphores[(index + 1) % ring.semaphores.size()].Signal();
+          });
+    });
+
+}  // namespace
@@ -0,0 +1,112 @@
+// Пул потоков из task-3-B.
+// Провилков Иван. гр.593.
+
+#include "bench.h"
+
+#include <chrono>
+#include <limits>
+
+#include "../task-3-B/task-3-B(Пул потоков).h"
+
+namespace {
+
+// Сколько задач отправляем за одну операцию в пакетном режиме.
+constexpr int kBurst = 64;
+
+// Потоки бенчмарка - это клиенты пула, сам пул размером с машину.
+bench::Registrar round_trip(
+    "thread_pool/submit_get", bench::kThreadsAxis,
+    [](const bench::Params&) {
+      return bench::MakeWorkload(
+          std::make_shared<ThreadPool<int>>(),
+          [](ThreadPool<int>& pool, bench::ThreadContext&) {
+            pool.Submit([] { return 1; }).get();
+          });
+    });
+
+// То же с токеном отмены: цена подписки на отмену и ее снятия.
+bench::Registrar cancellable_round_trip(
+    "thread_pool/submit_get_cancellable", bench::kThreadsAxis,
+    [](const bench::Params&) {
+      struct State {
+        ThreadPool<int> pool;
+        CancellationSource source;
+      };
+      return bench::MakeWorkload(
+          std::make_shared<State>(),
+          [](State& state, bench::ThreadContext&) {
+            state.pool.Submit([] { return 1; }, state.source.Token()).get();
+          });
+    });
+
+bench::Registrar burst(
+    "thread_pool/submit_burst", bench::kThreadsAxis,
+    [](const bench::Params&) {
+      return bench::MakeWorkload(
+          std::make_shared<ThreadPool<int>>(),
+          [](ThreadPool<int>& pool, bench::ThreadContext&) {
+            std::future<int> futures[kBurst];
+            for (auto& future : futures) {
+              future = pool.Submit([] { return 1; });
+            }
+            for (auto& future : futures) {
+              future.get();
+            }
+          });
+    });
+
+// То же с очередью на каждый узел NUMA и рабочими, привязанными к узлам.
+bench::Registrar numa_burst(
+    "thread_pool/submit_burst_node_queues", bench::kThreadsAxis,
+    [](const bench::Params&) {
+      ThreadPoolOptions options;
+      options.node_queues = true;
+      options.pinning = WorkerPinning::kNode;
+      return bench::MakeWorkload(
+          std::make_shared<ThreadPool<int>>(options),
+          [](ThreadPool<int>& pool, bench::ThreadContext&) {
+            std::future<int> futures[kBurst];
+            for (auto& future : futures) {
+              future = pool.Submit([] { return 1; });
+            }
+            for (auto& future : futures) {
+              future.get();
+            }
+          });
+    });
+
+// То же с включенной трассировкой, чтобы видеть ее цену. Буферы никто
+// не выгружает, так что после заполнения события выбрасываются.
+bench::Registrar traced_burst(
+    "thread_pool/submit_burst_traced", bench::kThreadsAxis,
+    [](const bench::Params&) {
+      auto pool = std::make_shared<ThreadPool<int>>();
+      pool->EnableTracing();
+      return bench::MakeWorkload(
+          std::move(pool),
+          [](ThreadPool<int>& pool, bench::ThreadContext&) {
+            std::future<int> futures[kBurst];
+            for (auto& future : futures) {
+              future = pool.Submit([] { return 1; });
+            }
+            for (auto& future : futures) {
+              future.get();
+            }
+          });
+    });
+
+// Вставка и отмена таймера, который не успевает сработать.
+bench::Registrar schedule_cancel(
+    "thread_pool/schedule_cancel", bench::kThreadsAxis,
+    [](const bench::Params&) {
+      return bench::MakeWorkload(
+          std::make_shared<ThreadPool<int>>(),
+          [](ThreadPool<int>& pool, bench::ThreadContext& context) {
+            TimerHandle timer = pool.ScheduleAfter(
+                std::chrono::seconds(10 + context.NextKey() % 1000),
+                [] { return 1; });
+            timer.Cancel();
+          });
+    });
+
+}  // namespace
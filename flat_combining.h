@@ -0,0 +1,308 @@
+#pragma once
+
+// Flat combining для структур, которые потоки рвут друг у друга.
+// Провилков Иван. гр.593.
+//
+// FlatCombiner<Structure>::Execute(f) не захватывает структуру сам, а
+// публикует операцию в своей записи и ждет. Поток, которому достался
+// замок комбинатора, выполняет подряд все опубликованные операции, так
+// что структура (и мьютекс внутри нее) остается в кэше одного ядра, а
+// остальные крутятся каждый на своей кэш-линии. Записи закреплены за
+// потоками по номеру потока. Без соперников (замок свободен) или без
+// свободной записи поток выполняет операцию сам под тем же замком.
+//
+// FlatCombiningQueue и FlatCombiningSet - обертки над BlockingQueue и
+// StripedHashSet (любыми классами с такими же операциями) с их
+// интерфейсом.
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace flat_combining_detail {
+
+inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  _mm_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield" ::: "memory");
+#endif
+}
+
+// Номер потока, общий для всех комбинаторов: по нему выбирается запись.
+inline size_t ThisThreadNumber() {
+  static std::atomic<size_t> next{0};
+  static thread_local const size_t number =
+      next.fetch_add(1, std::memory_order_relaxed);
+  return number;
+}
+
+}  // namespace flat_combining_detail
+
+template <class Structure>
+class FlatCombiner {
+ public:
+  explicit FlatCombiner(Structure& structure, size_t slots = DefaultSlots())
+      : structure_(structure), slots_(std::max<size_t>(slots, 1)) {}
+
+  FlatCombiner(const FlatCombiner&) = delete;
+  FlatCombiner& operator=(const FlatCombiner&) = delete;
+
+  static size_t DefaultSlots() {
+    return std::max<size_t>(2 * std::thread::hardware_concurrency(), 8);
+  }
+
+  // Выполняет function(structure) так, что никакие две операции этого
+  // комбинатора не идут одновременно, и возвращает результат по значению.
+  // Исключение function бросается в вызвавшем потоке.
+  template <class Function>
+  std::decay_t<std::invoke_result_t<Function&, Structure&> > Execute(
+      Function&& function) {
+    using Result = std::decay_t<std::invoke_result_t<Function&, Structure&> >;
+    Operation<std::remove_reference_t<Function>, Result> operation(function);
+    // Если замок свободен, соперников нет и публиковать операцию незачем.
+    // Если нет свободной записи, ждем замка.
+    bool locked = TryLock();
+    Slot* slot = locked ? nullptr : ClaimSlot();
+    if (slot == nullptr) {
+      for (int attempt = 0; !locked; ++attempt) {
+        Backoff(attempt);
+        locked = TryLock();
+      }
+      operation.Run(&operation, structure_);
+      Combine();
+      Unlock();
+      return operation.Take();
+    }
+    slot->run = &Operation<std::remove_reference_t<Function>, Result>::Run;
+    slot->operation = &operation;
+    slot->state.store(kPending, std::memory_order_release);
+    for (int attempt = 0;
+         slot->state.load(std::memory_order_acquire) != kDone; ++attempt) {
+      if (TryLock()) {
+        // Наша операция среди опубликованных, Combine ее выполнит.
+        Combine();
+        Unlock();
+      } else {
+        Backoff(attempt);
+      }
+    }
+    slot->state.store(kFree, std::memory_order_release);
+    return operation.Take();
+  }
+
+ private:
+  static constexpr uint32_t kFree = 0;
+  static constexpr uint32_t kClaimed = 1;
+  static constexpr uint32_t kPending = 2;
+  static constexpr uint32_t kDone = 3;
+
+  // Сколько раз комбинатор обходит записи, пока находит новые операции.
+  static constexpr int kCombinePasses = 3;
+  static constexpr int kSpinAttempts = 64;
+
+  template <class Function, class Result>
+  struct Operation {
+    explicit Operation(Function& function) : function(function) {}
+
+    static void Run(void* self, Structure& structure) {
+      Operation* operation = static_cast<Operation*>(self);
+      try {
+        if constexpr (std::is_void<Result>::value) {
+          operation->function(structure);
+        } else {
+          operation->result.emplace(operation->function(structure));
+        }
+      } catch (...) {
+        operation->error = std::current_exception();
+      }
+    }
+
+    Result Take() {
+      if (error != nullptr) {
+        std::rethrow_exception(error);
+      }
+      if constexpr (!std::is_void<Result>::value) {
+        return std::move(*result);
+      }
+    }
+
+    Function& function;
+    std::conditional_t<std::is_void<Result>::value, bool,
+                       std::optional<Result> > result{};
+    std::exception_ptr error;
+  };
+
+  // Запись потока. run и operation пишет владелец до публикации
+  // (kPending), комбинатор читает после.
+  struct alignas(64) Slot {
+    std::atomic<uint32_t> state{kFree};
+    void (*run)(void*, Structure&) = nullptr;
+    void* operation = nullptr;
+  };
+
+  Slot* ClaimSlot() {
+    const size_t start =
+        flat_combining_detail::ThisThreadNumber() % slots_.size();
+    for (size_t probe = 0; probe < slots_.size(); ++probe) {
+      const size_t index = (start + probe) % slots_.size();
+      Slot& slot = slots_[index];
+      uint32_t expected = kFree;
+      if (slot.state.load(std::memory_order_relaxed) == kFree &&
+          slot.state.compare_exchange_strong(expected, kClaimed,
+                                             std::memory_order_acquire,
+                                             std::memory_order_relaxed)) {
+        // Комбинатор, не увидевший новую границу, пропустит запись, но
+        // владелец сам станет комбинатором.
+        size_t used = used_slots_.load(std::memory_order_relaxed);
+        while (used <= index &&
+               !used_slots_.compare_exchange_weak(
+                   used, index + 1, std::memory_order_release,
+                   std::memory_order_relaxed)) {
+        }
+        return &slot;
+      }
+    }
+    return nullptr;
+  }
+
+  bool TryLock() {
+    return !combining_.load(std::memory_order_relaxed) &&
+        !combining_.exchange(true, std::memory_order_acquire);
+  }
+
+  void Unlock() {
+    combining_.store(false, std::memory_order_release);
+  }
+
+  void Combine() {
+    const size_t used = used_slots_.load(std::memory_order_acquire);
+    for (int pass = 0; pass < kCombinePasses; ++pass) {
+      bool found = false;
+      for (size_t index = 0; index < used; ++index) {
+        Slot& slot = slots_[index];
+        if (slot.state.load(std::memory_order_acquire) == kPending) {
+          slot.run(slot.operation, structure_);
+          slot.state.store(kDone, std::memory_order_release);
+          found = true;
+        }
+      }
+      if (!found) {
+        return;
+      }
+    }
+  }
+
+  static void Backoff(int attempt) {
+    if (attempt < kSpinAttempts) {
+      flat_combining_detail::CpuRelax();
+    } else {
+      std::this_thread::yield();
+    }
+  }
+
+  Structure& structure_;
+  alignas(64) std::atomic<bool> combining_{false};
+  alignas(64) std::atomic<size_t> used_slots_{0};
+  std::vector<Slot> slots_;
+};
+
+// BlockingQueue, у которой неблокирующие TryPut и TryGet идут через
+// комбинатор. Put и Get сначала пробуют их, а если очередь заполнена
+// (пуста), ждут на самой очереди.
+template <class T, template <class...> class Queue>
+class FlatCombiningQueue {
+ public:
+  explicit FlatCombiningQueue(const size_t capacity)
+      : queue_(capacity), combiner_(queue_) {}
+
+  void Put(T&& element) {
+    if (!TryPut(std::move(element))) {
+      queue_.Put(std::move(element));
+    }
+  }
+
+  bool TryPut(T&& element) {
+    return combiner_.Execute([&element](Queue<T>& queue) {
+      return queue.TryPut(std::move(element));
+    });
+  }
+
+  bool Get(T& result) {
+    return TryGet(result) || queue_.Get(result);
+  }
+
+  bool TryGet(T& result) {
+    return combiner_.Execute([&result](Queue<T>& queue) {
+      return queue.TryGet(result);
+    });
+  }
+
+  void Shutdown() {
+    queue_.Shutdown();
+  }
+
+ private:
+  Queue<T> queue_;
+  FlatCombiner<Queue<T> > combiner_;
+};
+
+// StripedHashSet с комбинированием операций. Если combiners делит
+// concurrency_level, то каждую полосу множества обслуживает ровно один
+// комбинатор, и горячая полоса не мешает остальным.
+template <class T, template <class...> class Set, class Hash = std::hash<T> >
+class FlatCombiningSet {
+ public:
+  explicit FlatCombiningSet(const size_t concurrency_level,
+                            const size_t combiners = 1)
+      : set_(concurrency_level) {
+    for (size_t i = 0; i < std::max<size_t>(combiners, 1); ++i) {
+      combiners_.push_back(std::make_unique<FlatCombiner<Set<T, Hash> > >(
+          set_));
+    }
+  }
+
+  bool Insert(const T& element) {
+    return CombinerFor(element).Execute([&element](Set<T, Hash>& set) {
+      return set.Insert(element);
+    });
+  }
+
+  bool Remove(const T& element) {
+    return CombinerFor(element).Execute([&element](Set<T, Hash>& set) {
+      return set.Remove(element);
+    });
+  }
+
+  bool Contains(const T& element) {
+    return CombinerFor(element).Execute([&element](Set<T, Hash>& set) {
+      return set.Contains(element);
+    });
+  }
+
+  size_t Size() const {
+    return set_.Size();
+  }
+
+ private:
+  FlatCombiner<Set<T, Hash> >& CombinerFor(const T& element) {
+    return *combiners_[hash_function_(element) % combiners_.size()];
+  }
+
+  Set<T, Hash> set_;
+  std::vector<std::unique_ptr<FlatCombiner<Set<T, Hash> > > > combiners_;
+  Hash hash_function_;
+};
@@ -0,0 +1,462 @@
+#pragma once
+
+// Профилирование захватов мьютексов.
+// Провилков Иван. гр.593.
+//
+// lock_profiler::Profiled<Mutex> - обертка над любым мьютексом с
+// try_lock (и try_lock_shared для читательских захватов), которая
+// считает захваты, захваты с ожиданием, время ожидания и время удержания
+// с гистограммами. Статистика пишется в буфер своего потока без общих
+// записей и собирается по требованию через Collect / PrintReport.
+//
+// Профилирование включается макросом CONCURRENCY_LOCK_PROFILING. Без
+// него Profiled<Mutex> - это сам Mutex, SetName ничего не делает, и
+// обертка не стоит ничего.
+//
+// Статистика ведется по экземпляру мьютекса, а если передать тег места
+// (Profiled<Mutex, Site>, где у Site есть static constexpr kName), то
+// общая для всех мьютексов с этим тегом - так удобнее для мьютексов в
+// узлах структур, которых миллионы.
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#ifdef CONCURRENCY_LOCK_PROFILING
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#endif
+
+namespace lock_profiler {
+
+// Гистограммы по степеням двойки наносекунд: корзина b содержит
+// значения из [2^b, 2^(b+1)).
+constexpr size_t kHistogramBuckets = 32;
+
+struct LockReport {
+  uint32_t id = 0;
+  std::string name;
+  uint64_t acquisitions = 0;
+  uint64_t shared_acquisitions = 0;
+  // Захваты, которые не удались с первой попытки и потребовали ожидания.
+  uint64_t contended = 0;
+  uint64_t wait_ns = 0;
+  uint64_t hold_ns = 0;
+  std::vector<uint64_t> wait_histogram =
+      std::vector<uint64_t>(kHistogramBuckets);
+  std::vector<uint64_t> hold_histogram =
+      std::vector<uint64_t>(kHistogramBuckets);
+};
+
+#ifdef CONCURRENCY_LOCK_PROFILING
+
+namespace detail {
+
+using Clock = std::chrono::steady_clock;
+
+// Идентификаторы мьютексов ограничены: все, что выше, попадает в
+// последнюю ячейку "overflow".
+constexpr uint32_t kPageSize = 256;
+constexpr uint32_t kPages = 64;
+constexpr uint32_t kMaxLocks = kPageSize * kPages;
+
+inline uint64_t NowNs() {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          Clock::now().time_since_epoch()).count());
+}
+
+inline size_t Bucket(const uint64_t nanoseconds) {
+  size_t bucket = 0;
+  while (bucket + 1 < kHistogramBuckets &&
+         (nanoseconds >> (bucket + 1)) != 0) {
+    ++bucket;
+  }
+  return bucket;
+}
+
+// Пишет только поток-владелец, поэтому атомарные переменные нужны лишь
+// для того, чтобы Collect мог читать их из другого потока; обновление -
+// relaxed load + store, без lock-префикса.
+struct Counter {
+  std::atomic<uint64_t> value{0};
+
+  void Add(const uint64_t delta) {
+    value.store(value.load(std::memory_order_relaxed) + delta,
+                std::memory_order_relaxed);
+  }
+
+  uint64_t Load() const {
+    return value.load(std::memory_order_relaxed);
+  }
+};
+
+struct LockStats {
+  Counter acquisitions;
+  Counter shared_acquisitions;
+  Counter contended;
+  Counter wait_ns;
+  Counter hold_ns;
+  std::array<Counter, kHistogramBuckets> wait_histogram;
+  std::array<Counter, kHistogramBuckets> hold_histogram;
+  // Время начала читательского захвата этим потоком.
+  uint64_t shared_acquired_at = 0;
+};
+
+// Буфер статистики одного потока. Страницы выделяются при первом
+// обращении к мьютексу с номером из этой страницы.
+class ThreadBuffer {
+ public:
+  ~ThreadBuffer() {
+    for (auto& page : pages_) {
+      delete page.load();
+    }
+  }
+
+  LockStats& Slot(const uint32_t id) {
+    std::atomic<Page*>& slot = pages_[id / kPageSize];
+    Page* page = slot.load(std::memory_order_acquire);
+    if (page == nullptr) {
+      page = new Page();
+      slot.store(page, std::memory_order_release);
+    }
+    return (*page)[id % kPageSize];
+  }
+
+  const LockStats* Find(const uint32_t id) const {
+    const Page* page =
+        pages_[id / kPageSize].load(std::memory_order_acquire);
+    return page == nullptr ? nullptr : &(*page)[id % kPageSize];
+  }
+
+ private:
+  using Page = std::array<LockStats, kPageSize>;
+
+  std::array<std::atomic<Page*>, kPages> pages_{};
+};
+
+class Registry {
+ public:
+  static Registry& Instance() {
+    static Registry registry;
+    return registry;
+  }
+
+  uint32_t NewId(const std::string& name) {
+    std::lock_guard<std::mutex> locker(mutex_);
+    if (names_.size() >= kMaxLocks - 1) {
+      if (names_.size() == kMaxLocks - 1) {
+        names_.push_back("overflow");
+      }
+      return kMaxLocks - 1;
+    }
+    names_.push_back(name);
+    return static_cast<uint32_t>(names_.size() - 1);
+  }
+
+  void SetName(const uint32_t id, const std::string& name) {
+    std::lock_guard<std::mutex> locker(mutex_);
+    if (id < names_.size() && id != kMaxLocks - 1) {
+      names_[id] = name;
+    }
+  }
+
+  ThreadBuffer& LocalBuffer() {
+    thread_local std::shared_ptr<ThreadBuffer> buffer = Attach();
+    return *buffer;
+  }
+
+  std::vector<LockReport> Collect() {
+    std::lock_guard<std::mutex> locker(mutex_);
+    std::vector<LockReport> reports;
+    for (uint32_t id = 0; id < names_.size(); ++id) {
+      LockReport report;
+      report.id = id;
+      report.name = names_[id];
+      for (const auto& buffer : buffers_) {
+        const LockStats* stats = buffer->Find(id);
+        if (stats == nullptr) {
+          continue;
+        }
+        report.acquisitions += stats->acquisitions.Load();
+        report.shared_acquisitions += stats->shared_acquisitions.Load();
+        report.contended += stats->contended.Load();
+        report.wait_ns += stats->wait_ns.Load();
+        report.hold_ns += stats->hold_ns.Load();
+        for (size_t bucket = 0; bucket < kHistogramBuckets; ++bucket) {
+          report.wait_histogram[bucket] +=
+              stats->wait_histogram[bucket].Load();
+          report.hold_histogram[bucket] +=
+              stats->hold_histogram[bucket].Load();
+        }
+      }
+      if (report.acquisitions + report.shared_acquisitions != 0) {
+        reports.push_back(std::move(report));
+      }
+    }
+    std::sort(reports.begin(), reports.end(),
+              [](const LockReport& left, const LockReport& right) {
+                return left.wait_ns > right.wait_ns;
+              });
+    return reports;
+  }
+
+ private:
+  Registry() {
+    names_.reserve(1024);
+  }
+
+  // Буферы завершившихся потоков остаются в реестре, чтобы их
+  // статистика попала в отчет.
+  std::shared_ptr<ThreadBuffer> Attach() {
+    auto buffer = std::make_shared<ThreadBuffer>();
+    std::lock_guard<std::mutex> locker(mutex_);
+    buffers_.push_back(buffer);
+    return buffer;
+  }
+
+  std::mutex mutex_;
+  std::vector<std::string> names_;
+  std::vector<std::shared_ptr<ThreadBuffer>> buffers_;
+};
+
+template <class Site>
+uint32_t SiteId() {
+  static const uint32_t id = Registry::Instance().NewId(Site::kName);
+  return id;
+}
+
+template <class Site>
+struct IdFor {
+  static uint32_t New() {
+    return SiteId<Site>();
+  }
+};
+
+template <>
+struct IdFor<void> {
+  static uint32_t New() {
+    return Registry::Instance().NewId("unnamed lock");
+  }
+};
+
+}  // namespace detail
+
+template <class Mutex, class Site = void>
+class ProfiledLock {
+ public:
+  ProfiledLock()
+      : id_(detail::IdFor<Site>::New()) {}
+
+  ProfiledLock(const ProfiledLock&) = delete;
+  ProfiledLock& operator=(const ProfiledLock&) = delete;
+
+  // Сначала пробуем захватить без ожидания: так отличаем захваты с
+  // конкуренцией от свободных.
+  void lock() {
+    detail::LockStats& stats = Stats();
+    if (mutex_.try_lock()) {
+      RecordWait(stats, 0, false);
+    } else {
+      const uint64_t start = detail::NowNs();
+      mutex_.lock();
+      RecordWait(stats, detail::NowNs() - start, true);
+    }
+    stats.acquisitions.Add(1);
+    // Пишет и читает только владелец мьютекса.
+    acquired_at_ = detail::NowNs();
+  }
+
+  bool try_lock() {
+    if (!mutex_.try_lock()) {
+      return false;
+    }
+    detail::LockStats& stats = Stats();
+    RecordWait(stats, 0, false);
+    stats.acquisitions.Add(1);
+    acquired_at_ = detail::NowNs();
+    return true;
+  }
+
+  void unlock() {
+    const uint64_t held = detail::NowNs() - acquired_at_;
+    mutex_.unlock();
+    RecordHold(Stats(), held);
+  }
+
+  void lock_shared() {
+    detail::LockStats& stats = Stats();
+    if (mutex_.try_lock_shared()) {
+      RecordWait(stats, 0, false);
+    } else {
+      const uint64_t start = detail::NowNs();
+      mutex_.lock_shared();
+      RecordWait(stats, detail::NowNs() - start, true);
+    }
+    stats.shared_acquisitions.Add(1);
+    stats.shared_acquired_at = detail::NowNs();
+  }
+
+  bool try_lock_shared() {
+    if (!mutex_.try_lock_shared()) {
+      return false;
+    }
+    detail::LockStats& stats = Stats();
+    RecordWait(stats, 0, false);
+    stats.shared_acquisitions.Add(1);
+    stats.shared_acquired_at = detail::NowNs();
+    return true;
+  }
+
+  void unlock_shared() {
+    detail::LockStats& stats = Stats();
+    const uint64_t held = detail::NowNs() - stats.shared_acquired_at;
+    mutex_.unlock_shared();
+    RecordHold(stats, held);
+  }
+
+  uint32_t Id() const {
+    return id_;
+  }
+
+  Mutex& Underlying() {
+    return mutex_;
+  }
+
+ private:
+  detail::LockStats& Stats() const {
+    return detail::Registry::Instance().LocalBuffer().Slot(id_);
+  }
+
+  static void RecordWait(detail::LockStats& stats, const uint64_t waited,
+                         const bool contended) {
+    if (contended) {
+      stats.contended.Add(1);
+      stats.wait_ns.Add(waited);
+    }
+    stats.wait_histogram[detail::Bucket(waited)].Add(1);
+  }
+
+  static void RecordHold(detail::LockStats& stats, const uint64_t held) {
+    stats.hold_ns.Add(held);
+    stats.hold_histogram[detail::Bucket(held)].Add(1);
+  }
+
+  Mutex mutex_;
+  uint32_t id_;
+  uint64_t acquired_at_ = 0;
+};
+
+template <class Mutex, class Site = void>
+using Profiled = ProfiledLock<Mutex, Site>;
+
+// Обертка - не std::mutex, поэтому с ней работает только
+// condition_variable_any.
+template <class Mutex>
+using ConditionVariableFor = std::condition_variable_any;
+
+template <class Mutex, class Site>
+void SetName(ProfiledLock<Mutex, Site>& lock, const char* name) {
+  detail::Registry::Instance().SetName(lock.Id(), name);
+}
+
+template <class Mutex, class Site>
+void SetName(ProfiledLock<Mutex, Site>& lock, const char* name,
+             const size_t index) {
+  detail::Registry::Instance().SetName(
+      lock.Id(), std::string(name) + "[" + std::to_string(index) + "]");
+}
+
+inline bool Enabled() {
+  return true;
+}
+
+inline std::vector<LockReport> Collect() {
+  return detail::Registry::Instance().Collect();
+}
+
+// Верхняя граница перцентиля по гистограмме.
+inline uint64_t PercentileUpperBound(const std::vector<uint64_t>& histogram,
+                                     const double quantile) {
+  uint64_t total = 0;
+  for (const uint64_t count : histogram) {
+    total += count;
+  }
+  uint64_t seen = 0;
+  for (size_t bucket = 0; bucket < histogram.size(); ++bucket) {
+    seen += histogram[bucket];
+    if (total != 0 &&
+        static_cast<double>(seen) >= quantile * static_cast<double>(total)) {
+      return uint64_t(1) << (bucket + 1);
+    }
+  }
+  return 0;
+}
+
+// Таблица самых "горячих" мьютексов по суммарному времени ожидания.
+inline void PrintReport(std::ostream& out, const size_t top = 20) {
+  const std::vector<LockReport> reports = Collect();
+  char line[256];
+  std::snprintf(line, sizeof(line), "%-40s %12s %12s %10s %14s %10s %10s\n",
+                "lock", "acquired", "shared", "contended", "wait ms",
+                "wait p99", "hold p99");
+  out << line;
+  for (size_t i = 0; i < reports.size() && i < top; ++i) {
+    const LockReport& report = reports[i];
+    std::snprintf(
+        line, sizeof(line),
+        "%-40s %12llu %12llu %10llu %14.3f %8lluns %8lluns\n",
+        report.name.c_str(),
+        static_cast<unsigned long long>(report.acquisitions),
+        static_cast<unsigned long long>(report.shared_acquisitions),
+        static_cast<unsigned long long>(report.contended),
+        static_cast<double>(report.wait_ns) / 1e6,
+        static_cast<unsigned long long>(
+            PercentileUpperBound(report.wait_histogram, 0.99)),
+        static_cast<unsigned long long>(
+            PercentileUpperBound(report.hold_histogram, 0.99)));
+    out << line;
+  }
+}
+
+#else  // CONCURRENCY_LOCK_PROFILING
+
+template <class Mutex, class Site = void>
+using Profiled = Mutex;
+
+template <class Mutex>
+using ConditionVariableFor =
+    typename std::conditional<std::is_same<Mutex, std::mutex>::value,
+                              std::condition_variable,
+                              std::condition_variable_any>::type;
+
+template <class Mutex>
+inline void SetName(Mutex&, const char*) {}
+
+template <class Mutex>
+inline void SetName(Mutex&, const char*, size_t) {}
+
+inline bool Enabled() {
+  return false;
+}
+
+inline std::vector<LockReport> Collect() {
+  return {};
+}
+
+inline void PrintReport(std::ostream& out, size_t = 20) {
+  out << "lock profiling is disabled, build with "
+         "-DCONCURRENCY_LOCK_PROFILING\n";
+}
+
+#endif  // CONCURRENCY_LOCK_PROFILING
+
+}  // namespace lock_profiler
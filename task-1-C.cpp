@@ -1,50 +1,139 @@
 // Реализация метода try_lock для ticket спинлока.
 // Провилков Иван. гр.593.
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 class ticket_spinlock {
 private:
     using ticket = std::size_t;
+
+    // Счетчики разнесены по разным кэш-линиям: next_free_ticket меняют
+    // только приходящие потоки, а owner_ticket читают все ожидающие, и
+    // без разнесения каждый fetch_add в lock инвалидировал бы линию,
+    // на которой крутятся ожидающие.
+    static constexpr std::size_t kCacheLineSize = 64;
+
+    // Сколько итераций pause ждем на каждый поток, стоящий перед нами в
+    // очереди. Порядок величины - время одной передачи lock-а.
+    static constexpr std::size_t kBackoffPerWaiter = 32;
+
+    // Больше стольких потоков перед собой пауза не учитывает.
+    static constexpr std::size_t kMaxBackoffWaiters = 64;
+
 public:
     ticket_spinlock()
             : owner_ticket(0)
             , next_free_ticket(0)
     {}
 
+    ticket_spinlock(const ticket_spinlock&) = delete;
+    ticket_spinlock& operator=(const ticket_spinlock&) = delete;
+
     // Семантика: если мы можем захватить lock без ожидания, то мы захватываем
     // его и возвращаем true, иначе false.
     // Объяснение.
     // Атомарная функция f.compare_exchange_strong(A, B) сравнивает то,
     // что записано в f с A, если они совпадают пишет B в f и возвращает true,
     // иначе возвращает false.
-    // Таким образом, мы считываем текущее значение owner_ticket в temp и затем
-    // используем функцию compare_exchange_strong, и если next_free_ticket
-    // == temp (что эквивалентно взятию lock без ожидания),
-    // то мы забираем текущий  next_free_ticket, добавляем на его
-    // место temp + 1 и возвращаем true(берем lock),
+    // Таким образом, мы считываем текущее значение owner_ticket в owner и
+    // затем используем функцию compare_exchange_strong, и если
+    // next_free_ticket == owner (что эквивалентно взятию lock без ожидания),
+    // то мы забираем текущий next_free_ticket, добавляем на его
+    // место owner + 1 и возвращаем true(берем lock),
     // иначе просто возвращаем false.
     // Так как compare_exchange_strong атомарна, то неудачный вызов try_lock
     // не влияет на другие потоки.
     // Таким образом мы реализовали корректный try_lock().
     bool try_lock() {
-        temp = owner_ticket.load();
-        return next_free_ticket.compare_exchange_strong(temp, temp + 1);
+        const ticket owner = owner_ticket.load(std::memory_order_acquire);
+        ticket expected = owner;
+        return next_free_ticket.compare_exchange_strong(
+                expected, owner + 1,
+                std::memory_order_acquire, std::memory_order_relaxed);
     }
 
+    // Ждем не просто в цикле, а пропорционально расстоянию до нашего
+    // билета: если между владельцем и нами k потоков, то раньше чем через
+    // k передач lock-а наша очередь не наступит, и лишний раз читать
+    // owner_ticket незачем - это только нагружает шину. Следующий за
+    // владельцем опрашивает owner_ticket непрерывно, чтобы не опоздать к
+    // передаче.
     void lock() {
-        ticket this_thread_ticket = next_free_ticket.fetch_add(1);
-        while (owner_ticket.load() != this_thread_ticket) {
-            // wait
+        const ticket this_thread_ticket =
+                next_free_ticket.fetch_add(1, std::memory_order_relaxed);
+        while (true) {
+            const ticket current =
+                    owner_ticket.load(std::memory_order_acquire);
+            if (current == this_thread_ticket) {
+                return;
+            }
+            Backoff(this_thread_ticket - current - 1);
         }
     }
 
+    // Аналог try_lock, но ждем освобождения не дольше timeout.
+    // Встать в очередь за билетом и потом уйти из нее нельзя (владелец не
+    // сможет передать lock следующему), поэтому повторяем try_lock с
+    // пропорциональной паузой, пока не выйдет время.
+    template <class Rep, class Period>
+    bool try_lock_for(const std::chrono::duration<Rep, Period>& timeout) {
+        return try_lock_until(std::chrono::steady_clock::now() + timeout);
+    }
+
+    template <class Clock, class Duration>
+    bool try_lock_until(
+            const std::chrono::time_point<Clock, Duration>& deadline) {
+        while (!try_lock()) {
+            if (Clock::now() >= deadline) {
+                return false;
+            }
+            const ticket owner =
+                    owner_ticket.load(std::memory_order_relaxed);
+            const ticket next =
+                    next_free_ticket.load(std::memory_order_relaxed);
+            // Загрузки двух разных переменных не согласованы между собой,
+            // и next может оказаться не больше owner.
+            Backoff(next > owner ? next - owner - 1 : 0);
+        }
+        return true;
+    }
+
+    // owner_ticket меняет только владелец lock-а, поэтому атомарное
+    // увеличение не нужно: обычные load + store(release) дешевле, чем
+    // fetch_add, и не требуют захвата линии в монопольном режиме дважды.
     void unlock() {
-        owner_ticket.store(owner_ticket.load() + 1);
+        const ticket current = owner_ticket.load(std::memory_order_relaxed);
+        owner_ticket.store(current + 1, std::memory_order_release);
     }
 
 private:
-    std::atomic<ticket_t> owner_ticket;
-    std::atomic<ticket_t> next_free_ticket;
-};
+    static void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+        _mm_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield" ::: "memory");
+#endif
+    }
 
+    // waiters - сколько потоков получат lock раньше нас, не считая
+    // владельца.
+    static void Backoff(const ticket waiters) {
+        const std::size_t pauses =
+                std::min<ticket>(waiters, kMaxBackoffWaiters) *
+                kBackoffPerWaiter;
+        CpuRelax();
+        for (std::size_t i = 0; i < pauses; ++i) {
+            CpuRelax();
+        }
+    }
+
+    alignas(kCacheLineSize) std::atomic<ticket> owner_ticket;
+    alignas(kCacheLineSize) std::atomic<ticket> next_free_ticket;
+};
@@ -4,12 +4,19 @@
 // Провилков Иван. гр.593.
 // Методы названы по кодстайлу, а не для фрэймворка контеста.
 
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <cstdint>
 #include <iostream>
 #include <stack>
 #include <thread>
 #include <vector>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
 // Мьютекс Петерсона. Взят из лекции.
 class PetersonMutex {
  public:
@@ -111,3 +118,146 @@ class TreeMutex {
     return power;
   }
 };
+
+// Tournament tree mutex, оптимизированный под случай без конкуренции.
+// Отличия от TreeMutex:
+// - поверх дерева стоит один флаг gate_, именно он обеспечивает взаимное
+//   исключение. Если в дереве никого нет, поток захватывает gate_ сразу,
+//   не поднимаясь по дереву (один exchange вместо log(n) мьютексов
+//   Петерсона). Дерево же отбирает из конкурирующих потоков одного,
+//   который будет ждать gate_, так что на флаге крутится не больше
+//   одного потока из дерева;
+// - вершины дерева выровнены по кэш-линиям, чтобы потоки из разных
+//   поддеревьев не мешали друг другу;
+// - в мьютексе Петерсона только запись victim_ делается через exchange,
+//   остальные операции - relaxed/acquire/release;
+// - путь от листа к корню считается один раз в конструкторе, Unlock идет
+//   по нему итеративно.
+class FastTreeMutex {
+ public:
+  explicit FastTreeMutex(const int n_threads)
+      : paths_(n_threads),
+        acquired_via_tree_(n_threads),
+        waiters_in_tree_(0),
+        gate_(false) {
+    const int leaves = static_cast<int>(Pow2(n_threads));
+    nodes_ = std::vector<Node>(std::max(leaves - 1, 1));
+    for (int thread = 0; thread < n_threads; ++thread) {
+      int position = thread + leaves - 1;
+      while (position != 0) {
+        const int parent = (position - 1) / 2;
+        paths_[thread].push_back({parent, position % 2 == 0 ? 1 : 0});
+        position = parent;
+      }
+    }
+  }
+
+  FastTreeMutex(const FastTreeMutex&) = delete;
+  FastTreeMutex& operator=(const FastTreeMutex&) = delete;
+
+  void Lock(const int thread_index) {
+    // Быстрый путь: пока в дереве никто не ждет, не поднимаемся по нему.
+    // Проверка waiters_in_tree_ не дает быстрым потокам бесконечно
+    // обгонять того, кто уже прошел дерево.
+    if (waiters_in_tree_.load(std::memory_order_relaxed) == 0 &&
+        !gate_.exchange(true, std::memory_order_acquire)) {
+      acquired_via_tree_[thread_index].value = false;
+      return;
+    }
+
+    waiters_in_tree_.fetch_add(1, std::memory_order_relaxed);
+    for (const Step& step : paths_[thread_index]) {
+      nodes_[step.node].Lock(step.side);
+    }
+    // Мы победили в дереве, осталось дождаться потока с быстрого пути.
+    while (gate_.load(std::memory_order_relaxed) ||
+        gate_.exchange(true, std::memory_order_acquire)) {
+      CpuRelax();
+    }
+    waiters_in_tree_.fetch_sub(1, std::memory_order_relaxed);
+    acquired_via_tree_[thread_index].value = true;
+  }
+
+  void Unlock(const int thread_index) {
+    gate_.store(false, std::memory_order_release);
+    if (!acquired_via_tree_[thread_index].value) {
+      return;
+    }
+    // Как и в TreeMutex, отпускаем мьютексы от корня к листу.
+    const std::vector<Step>& path = paths_[thread_index];
+    for (auto step = path.rbegin(); step != path.rend(); ++step) {
+      nodes_[step->node].Unlock(step->side);
+    }
+  }
+
+ private:
+  static constexpr size_t kCacheLineSize = 64;
+
+  // Сколько раз крутимся с pause, прежде чем отдать квант планировщику.
+  static constexpr int kSpinsBeforeYield = 128;
+
+  // Мьютекс Петерсона для вершины дерева.
+  // Порядок памяти: want_ пишется relaxed, а victim_ через exchange с
+  // acq_rel. Все exchange над victim_ упорядочены, и поток, сделавший
+  // свой exchange позже, синхронизируется с более ранним и обязательно
+  // увидит его want_ == true, то есть будет ждать. Загрузки в цикле
+  // ожидания - acquire, чтобы увидеть результаты критической секции
+  // предыдущего владельца.
+  struct alignas(kCacheLineSize) Node {
+    std::array<std::atomic<bool>, 2> want_{{false, false}};
+    std::atomic<int> victim_{0};
+
+    void Lock(const int side) {
+      want_[side].store(true, std::memory_order_relaxed);
+      victim_.exchange(side, std::memory_order_acq_rel);
+      int spins = 0;
+      while (want_[1 - side].load(std::memory_order_acquire) &&
+          victim_.load(std::memory_order_acquire) == side) {
+        if (++spins < kSpinsBeforeYield) {
+          CpuRelax();
+        } else {
+          spins = 0;
+          std::this_thread::yield();
+        }
+      }
+    }
+
+    void Unlock(const int side) {
+      want_[side].store(false, std::memory_order_release);
+    }
+  };
+
+  // Шаг пути от листа к корню: вершина и сторона, с которой мы в нее
+  // приходим.
+  struct Step {
+    int node;
+    int side;
+  };
+
+  // Флаг отдельного потока, на своей кэш-линии.
+  struct alignas(kCacheLineSize) PaddedFlag {
+    bool value = false;
+  };
+
+  static void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+  }
+
+  static int64_t Pow2(const int64_t number) {
+    int64_t power = 1;
+    while (power < number) {
+      power *= 2;
+    }
+    return power;
+  }
+
+  std::vector<Node> nodes_;
+  std::vector<std::vector<Step>> paths_;
+  std::vector<PaddedFlag> acquired_via_tree_;
+  alignas(kCacheLineSize) std::atomic<int> waiters_in_tree_;
+  alignas(kCacheLineSize) std::atomic<bool> gate_;
+};
@@ -0,0 +1,188 @@
+#pragma once
+
+// Барьер с раздельными фазами и Phaser.
+// Провилков Иван. гр.593.
+//
+
+#include "task-2-A(Спиннинг барьеры).h"
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <string>
+
+class PhaserException : public std::exception {
+ public:
+  explicit PhaserException(const std::string& log)
+      : log_(log) {}
+
+  const char* what() const noexcept override {
+    return log_.c_str();
+  }
+
+  std::string log_;
+};
+
+// Phaser в духе java.util.concurrent.Phaser.
+// Число участников может меняться между фазами: Register добавляет
+// участника в текущую фазу, ArriveAndDeregister приходит и уходит.
+// Приход (Arrive) и ожидание (AwaitAdvance) разделены: пришедший поток
+// может делать независимую работу и ждать конца фазы позже.
+//
+// Все состояние лежит в одном 64-битном слове
+// [номер фазы : 32 | участники : 16 | еще не пришли : 16], поэтому
+// приход, регистрация и переход к следующей фазе - это один CAS.
+// Ждущие потоки смотрят на отдельный счетчик завершенных фаз.
+class Phaser {
+ public:
+  static constexpr uint32_t kMaxParties = 0xffff;
+
+  explicit Phaser(const uint32_t parties = 0)
+      : state_(Pack(0, CheckParties(parties), parties)),
+        advanced_phases_(0) {}
+
+  Phaser(const Phaser&) = delete;
+  Phaser& operator=(const Phaser&) = delete;
+
+  // Добавляет участника в текущую фазу. Возвращает номер фазы.
+  uint32_t Register() {
+    uint64_t state = state_.load(std::memory_order_relaxed);
+    while (true) {
+      const uint32_t parties = Parties(state) + 1;
+      CheckParties(parties);
+      const uint64_t next = Pack(Phase(state), parties, Unarrived(state) + 1);
+      if (state_.compare_exchange_weak(state, next,
+                                       std::memory_order_acq_rel,
+                                       std::memory_order_relaxed)) {
+        return Phase(state);
+      }
+    }
+  }
+
+  // Отмечает приход в текущей фазе без ожидания.
+  // Возвращает номер фазы, которую потом можно передать в AwaitAdvance.
+  uint32_t Arrive() {
+    return DoArrive(false);
+  }
+
+  // Приходит в текущей фазе и перестает быть участником.
+  uint32_t ArriveAndDeregister() {
+    return DoArrive(true);
+  }
+
+  // Ждет, пока фаза phase не закончится.
+  void AwaitAdvance(const uint32_t phase) const {
+    advanced_phases_.WaitUntil([phase](const uint32_t advanced) {
+      return static_cast<int32_t>(advanced - phase) > 0;
+    });
+  }
+
+  // Аналог CyclicBarrier::Pass. Возвращает номер новой фазы.
+  uint32_t ArriveAndAwaitAdvance() {
+    const uint32_t phase = Arrive();
+    AwaitAdvance(phase);
+    return phase + 1;
+  }
+
+  uint32_t Phase() const {
+    return Phase(state_.load(std::memory_order_acquire));
+  }
+
+  uint32_t RegisteredParties() const {
+    return Parties(state_.load(std::memory_order_acquire));
+  }
+
+  uint32_t UnarrivedParties() const {
+    return Unarrived(state_.load(std::memory_order_acquire));
+  }
+
+ private:
+  uint32_t DoArrive(const bool deregister) {
+    uint64_t state = state_.load(std::memory_order_relaxed);
+    while (true) {
+      const uint32_t phase = Phase(state);
+      const uint32_t unarrived = Unarrived(state);
+      if (unarrived == 0) {
+        throw PhaserException("Arrive of an unregistered party");
+      }
+      const uint32_t parties = Parties(state) - (deregister ? 1 : 0);
+      // Последний пришедший сразу переводит Phaser в следующую фазу с
+      // актуальным числом участников.
+      const uint64_t next = unarrived == 1
+          ? Pack(phase + 1, parties, parties)
+          : Pack(phase, parties, unarrived - 1);
+      if (state_.compare_exchange_weak(state, next,
+                                       std::memory_order_acq_rel,
+                                       std::memory_order_relaxed)) {
+        if (unarrived == 1) {
+          // Каждый переход увеличивает счетчик ровно на один, так что
+          // даже если два перехода подряд опубликуются не по порядку,
+          // ждущий фазы p не проснется раньше, чем она закончится.
+          advanced_phases_.Add(1);
+        }
+        return phase;
+      }
+    }
+  }
+
+  static uint32_t CheckParties(const uint32_t parties) {
+    if (parties > kMaxParties) {
+      throw PhaserException("Too many parties");
+    }
+    return parties;
+  }
+
+  static uint64_t Pack(const uint32_t phase, const uint32_t parties,
+                       const uint32_t unarrived) {
+    return (static_cast<uint64_t>(phase) << 32) |
+        (static_cast<uint64_t>(parties) << 16) | unarrived;
+  }
+
+  static uint32_t Phase(const uint64_t state) {
+    return static_cast<uint32_t>(state >> 32);
+  }
+
+  static uint32_t Parties(const uint64_t state) {
+    return static_cast<uint32_t>(state >> 16) & kMaxParties;
+  }
+
+  static uint32_t Unarrived(const uint64_t state) {
+    return static_cast<uint32_t>(state) & kMaxParties;
+  }
+
+  alignas(WaitWord::kCacheLineSize) std::atomic<uint64_t> state_;
+  WaitWord advanced_phases_;
+};
+
+// Барьер с раздельными фазами для фиксированного числа потоков.
+// Arrive() отмечает приход и сразу возвращает жетон фазы, Wait(token)
+// блокирует до конца этой фазы. Между ними поток может считать то, что
+// не зависит от остальных (например, внутренность блока в stencil, пока
+// соседи досчитывают границы).
+class SplitPhaseBarrier {
+ public:
+  using ArrivalToken = uint32_t;
+
+  explicit SplitPhaseBarrier(const uint32_t num_threads)
+      : phaser_(num_threads) {}
+
+  ArrivalToken Arrive() {
+    return phaser_.Arrive();
+  }
+
+  void Wait(const ArrivalToken token) const {
+    phaser_.AwaitAdvance(token);
+  }
+
+  void ArriveAndWait() {
+    Wait(Arrive());
+  }
+
+  // Приходит в текущей фазе и уменьшает число потоков для следующих.
+  void ArriveAndDrop() {
+    phaser_.ArriveAndDeregister();
+  }
+
+ private:
+  Phaser phaser_;
+};
@@ -0,0 +1,360 @@
+#pragma once
+
+// Барьеры на активном ожидании.
+// Провилков Иван. гр.593.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Слово, на котором потоки ждут смены значения.
+// Сначала крутимся с pause (при передаче управления между ядрами это
+// самый быстрый вариант), а если ждать приходится долго (потоков больше,
+// чем ядер), засыпаем на futex. Тот, кто меняет значение, делает
+// системный вызов, только если кто-то действительно спит.
+class WaitWord {
+ public:
+  static constexpr size_t kCacheLineSize = 64;
+
+  explicit WaitWord(const uint32_t value = 0)
+      : value_(value), sleepers_(0) {}
+
+  uint32_t Load() const {
+    return value_.load(std::memory_order_acquire);
+  }
+
+  // Ждем, пока done(значение) не станет true.
+  template <class Predicate>
+  void WaitUntil(Predicate done) const {
+    // Длительность pause от процессора к процессору отличается в десятки
+    // раз (около 10 тактов до Skylake, около 140 после), поэтому бюджет
+    // ожидания меряем часами, а не числом итераций. Часы читаем раз в
+    // kSpinsPerClockCheck итераций, и первая пачка обходится без них.
+    std::chrono::steady_clock::time_point spin_start;
+    for (int spin = 1;; ++spin) {
+      if (done(value_.load(std::memory_order_acquire))) {
+        return;
+      }
+      CpuRelax();
+      if (spin % kSpinsPerClockCheck == 0) {
+        const auto now = std::chrono::steady_clock::now();
+        if (spin == kSpinsPerClockCheck) {
+          spin_start = now;
+        } else if (now - spin_start >= kSpinBudget) {
+          break;
+        }
+      }
+    }
+    sleepers_.fetch_add(1, std::memory_order_seq_cst);
+    while (true) {
+      const uint32_t current = value_.load(std::memory_order_seq_cst);
+      if (done(current)) {
+        break;
+      }
+      Park(current);
+    }
+    sleepers_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  void Store(const uint32_t value) {
+    value_.store(value, std::memory_order_seq_cst);
+    WakeAll();
+  }
+
+  void Add(const uint32_t delta) {
+    value_.fetch_add(delta, std::memory_order_seq_cst);
+    WakeAll();
+  }
+
+  static void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+  }
+
+ private:
+  // Сколько крутимся до засыпания на futex.
+  static constexpr std::chrono::microseconds kSpinBudget{5};
+  static constexpr int kSpinsPerClockCheck = 32;
+
+  void WakeAll() {
+    if (sleepers_.load(std::memory_order_seq_cst) == 0) {
+      return;
+    }
+#if defined(__linux__)
+    syscall(SYS_futex, FutexWord(), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr,
+            nullptr, 0);
+#endif
+  }
+
+  // Ядро проверяет, что значение все еще равно observed, поэтому
+  // изменение между нашей проверкой и засыпанием не теряется.
+  void Park(const uint32_t observed) const {
+#if defined(__linux__)
+    syscall(SYS_futex, FutexWord(), FUTEX_WAIT_PRIVATE, observed, nullptr,
+            nullptr, 0);
+#else
+    (void)observed;
+    std::this_thread::yield();
+#endif
+  }
+
+  uint32_t* FutexWord() const {
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+                  "futex needs a plain 32-bit word");
+    return reinterpret_cast<uint32_t*>(
+        const_cast<std::atomic<uint32_t>*>(&value_));
+  }
+
+  alignas(kCacheLineSize) std::atomic<uint32_t> value_;
+  mutable std::atomic<uint32_t> sleepers_;
+};
+
+// Функция завершения фазы по умолчанию: ничего не делает.
+struct NoCompletion {
+  void operator()() const {}
+};
+
+// Централизованный барьер с обращением смысла (sense-reversing).
+// Все потоки уменьшают один счетчик, последний сбрасывает его и меняет
+// номер фазы, остальные ждут смены фазы. Номер фазы - это обобщение
+// флага sense: четность номера и есть sense. Самый дешевый вариант при
+// небольшом числе потоков.
+class CentralBarrierPolicy {
+ public:
+  static constexpr bool kSupportsDrop = true;
+
+  explicit CentralBarrierPolicy(const size_t participants)
+      : expected_(participants),
+        remaining_(participants),
+        pending_drops_(0) {}
+
+  template <class Completion>
+  void Arrive(size_t /*thread_index*/, const bool drop,
+              Completion& complete) {
+    // Фазу читаем до прихода: пока мы не пришли, она не сменится.
+    const uint32_t phase = phase_.Load();
+    if (drop) {
+      pending_drops_.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      expected_ -= pending_drops_.exchange(0, std::memory_order_relaxed);
+      remaining_.store(expected_, std::memory_order_relaxed);
+      complete();
+      phase_.Store(phase + 1);
+    } else if (!drop) {
+      phase_.WaitUntil([phase](const uint32_t current) {
+        return current != phase;
+      });
+    }
+  }
+
+ private:
+  // Меняется только последним пришедшим потоком.
+  size_t expected_;
+  alignas(WaitWord::kCacheLineSize) std::atomic<size_t> remaining_;
+  std::atomic<size_t> pending_drops_;
+  WaitWord phase_;
+};
+
+// Комбинирующее дерево: потоки разбиты на группы по kArity, каждая группа
+// уменьшает свой счетчик, последний в группе поднимается к родителю.
+// Так на каждом счетчике конкурируют не больше kArity потоков. Последний
+// пришедший в корень меняет общий номер фазы, на котором ждут все.
+class CombiningTreeBarrierPolicy {
+ public:
+  static constexpr bool kSupportsDrop = true;
+  static constexpr size_t kArity = 4;
+
+  explicit CombiningTreeBarrierPolicy(const size_t participants) {
+    // Строим дерево снизу вверх: уровень из level_size вершин, у каждой
+    // не больше kArity детей.
+    size_t level_size = participants;
+    size_t level_begin = 0;
+    std::vector<size_t> children_count;
+    do {
+      const size_t parents = (level_size + kArity - 1) / kArity;
+      for (size_t parent = 0; parent < parents; ++parent) {
+        children_count.push_back(
+            std::min(kArity, level_size - parent * kArity));
+      }
+      level_begins_.push_back(level_begin);
+      level_begin = children_count.size();
+      level_size = parents;
+    } while (level_size > 1);
+
+    nodes_ = std::vector<Node>(children_count.size());
+    for (size_t level = 0; level < level_begins_.size(); ++level) {
+      const size_t begin = level_begins_[level];
+      const size_t end = level + 1 < level_begins_.size()
+          ? level_begins_[level + 1] : nodes_.size();
+      for (size_t index = begin; index < end; ++index) {
+        nodes_[index].expected_ = children_count[index];
+        nodes_[index].remaining_.store(children_count[index]);
+        nodes_[index].parent_ = end == nodes_.size()
+            ? nullptr : &nodes_[end + (index - begin) / kArity];
+      }
+    }
+  }
+
+  template <class Completion>
+  void Arrive(const size_t thread_index, const bool drop,
+              Completion& complete) {
+    const uint32_t phase = phase_.Load();
+    Node* node = &nodes_[thread_index / kArity];
+    bool leaves_node = drop;
+    while (true) {
+      if (leaves_node) {
+        node->pending_drops_.fetch_add(1, std::memory_order_relaxed);
+      }
+      if (node->remaining_.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        break;
+      }
+      // Мы последние в этой вершине: переводим ее в следующую фазу.
+      // Если из нее ушли все, она уходит и из родителя.
+      node->expected_ -=
+          node->pending_drops_.exchange(0, std::memory_order_relaxed);
+      node->remaining_.store(node->expected_, std::memory_order_relaxed);
+      leaves_node = node->expected_ == 0;
+      if (node->parent_ == nullptr) {
+        complete();
+        phase_.Store(phase + 1);
+        return;
+      }
+      node = node->parent_;
+    }
+    if (!drop) {
+      phase_.WaitUntil([phase](const uint32_t current) {
+        return current != phase;
+      });
+    }
+  }
+
+ private:
+  struct alignas(WaitWord::kCacheLineSize) Node {
+    size_t expected_ = 0;
+    std::atomic<size_t> remaining_{0};
+    std::atomic<size_t> pending_drops_{0};
+    Node* parent_ = nullptr;
+  };
+
+  std::vector<Node> nodes_;
+  std::vector<size_t> level_begins_;
+  WaitWord phase_;
+};
+
+// Диссеминационный барьер: ceil(log2 n) раундов, в раунде r поток i
+// сигналит потоку (i + 2^r) mod n и ждет сигнала от (i - 2^r) mod n.
+// Нет ни одной общей переменной, на которой конкурировали бы все потоки,
+// и нет отдельной фазы освобождения. Число участников фиксировано,
+// ArriveAndDrop не поддерживается.
+class DisseminationBarrierPolicy {
+ public:
+  static constexpr bool kSupportsDrop = false;
+
+  explicit DisseminationBarrierPolicy(const size_t participants)
+      : participants_(participants), rounds_(0) {
+    while ((size_t(1) << rounds_) < participants_) {
+      ++rounds_;
+    }
+    flags_ = std::vector<WaitWord>(participants_ * rounds_);
+    phases_ = std::vector<PaddedPhase>(participants_);
+  }
+
+  template <class Completion>
+  void Arrive(const size_t thread_index, bool /*drop*/,
+              Completion& complete) {
+    // Счетчики сигналов только растут, поэтому sense не нужен: в фазе p
+    // ждем, пока счетчик не дойдет до p + 1.
+    const uint32_t target = ++phases_[thread_index].value;
+    for (size_t round = 0; round < rounds_; ++round) {
+      const size_t partner =
+          (thread_index + (size_t(1) << round)) % participants_;
+      Flag(partner, round).Add(1);
+      Flag(thread_index, round).WaitUntil([target](const uint32_t signals) {
+        return static_cast<int32_t>(signals - target) >= 0;
+      });
+    }
+    if (std::is_same<Completion, NoCompletion>::value) {
+      return;
+    }
+    // Функция завершения должна выполниться ровно один раз и до того,
+    // как кто-то пойдет дальше, поэтому нужен еще один общий шаг.
+    if (thread_index == 0) {
+      complete();
+      completed_.Store(target);
+    } else {
+      completed_.WaitUntil([target](const uint32_t phase) {
+        return static_cast<int32_t>(phase - target) >= 0;
+      });
+    }
+  }
+
+ private:
+  struct alignas(WaitWord::kCacheLineSize) PaddedPhase {
+    uint32_t value = 0;
+  };
+
+  WaitWord& Flag(const size_t thread_index, const size_t round) {
+    return flags_[thread_index * rounds_ + round];
+  }
+
+  const size_t participants_;
+  size_t rounds_;
+  std::vector<WaitWord> flags_;
+  std::vector<PaddedPhase> phases_;
+  WaitWord completed_;
+};
+
+// Циклический барьер на активном ожидании с интерфейсом как у std::barrier.
+// Алгоритм выбирается политикой, CompletionFunction выполняется одним
+// потоком в конце каждой фазы, до того как остальные пойдут дальше.
+// Каждый участник передает свой номер из [0, participants) - он нужен
+// дереву и диссеминационному барьеру.
+template <class Policy = CentralBarrierPolicy,
+          class CompletionFunction = NoCompletion>
+class SpinningBarrier {
+ public:
+  explicit SpinningBarrier(
+      const size_t participants,
+      CompletionFunction completion = CompletionFunction())
+      : policy_(participants), completion_(std::move(completion)) {}
+
+  SpinningBarrier(const SpinningBarrier&) = delete;
+  SpinningBarrier& operator=(const SpinningBarrier&) = delete;
+
+  void ArriveAndWait(const size_t thread_index) {
+    policy_.Arrive(thread_index, false, completion_);
+  }
+
+  // Приходим на барьер в текущей фазе, не ждем остальных и выходим из
+  // числа участников для следующих фаз.
+  void ArriveAndDrop(const size_t thread_index) {
+    static_assert(Policy::kSupportsDrop,
+                  "this barrier policy has a fixed set of participants");
+    policy_.Arrive(thread_index, true, completion_);
+  }
+
+ private:
+  Policy policy_;
+  CompletionFunction completion_;
+};
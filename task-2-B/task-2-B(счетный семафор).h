@@ -0,0 +1,190 @@
+#pragma once
+
+// Счетный семафор на futex.
+// Провилков Иван. гр.593.
+//
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Семафор со счетчиком жетонов.
+// Пока жетоны есть, Wait и Signal - это одна атомарная операция над
+// count_, без мьютекса и системных вызовов. В ядро (futex) идем, только
+// когда жетонов нет и ждать действительно нужно, а Signal делает
+// системный вызов, только если кто-то уже спит.
+class Semaphore {
+ public:
+  explicit Semaphore(const int32_t initial_count = 0)
+      : count_(initial_count), sleepers_(0) {}
+
+  Semaphore(const Semaphore&) = delete;
+  Semaphore& operator=(const Semaphore&) = delete;
+
+  // Берем жетон, если он есть. Никогда не блокируется.
+  bool TryWait() {
+    int32_t count = count_.load(std::memory_order_relaxed);
+    while (count > 0) {
+      if (count_.compare_exchange_weak(count, count - 1,
+                                       std::memory_order_acquire,
+                                       std::memory_order_relaxed)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Если есть жетон, то сразу берем его и заходим, если нет то ждем
+  // пока появится.
+  void Wait() {
+    if (SpinForToken()) {
+      return;
+    }
+    sleepers_.fetch_add(1, std::memory_order_seq_cst);
+    while (!TryWait()) {
+      Park(nullptr);
+    }
+    sleepers_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  // Ждем жетон не дольше timeout. Возвращает true, если жетон взят.
+  template <class Rep, class Period>
+  bool WaitFor(const std::chrono::duration<Rep, Period>& timeout) {
+    const auto deadline = std::chrono::steady_clock::now() +
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            timeout);
+    if (SpinForToken()) {
+      return true;
+    }
+    sleepers_.fetch_add(1, std::memory_order_seq_cst);
+    bool acquired = TryWait();
+    while (!acquired && Park(&deadline)) {
+      acquired = TryWait();
+    }
+    sleepers_.fetch_sub(1, std::memory_order_relaxed);
+    return acquired || TryWait();
+  }
+
+  // Кладем tokens жетонов и будим не больше tokens спящих потоков одним
+  // системным вызовом.
+  void Signal(const int32_t tokens = 1) {
+    // seq_cst в паре с увеличением sleepers_ в Wait: либо ждущий увидит
+    // новый жетон, либо мы увидим ждущего и разбудим его.
+    count_.fetch_add(tokens, std::memory_order_seq_cst);
+    if (sleepers_.load(std::memory_order_seq_cst) > 0) {
+      Wake(tokens);
+    }
+  }
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  // Сколько раз пробуем взять жетон перед тем, как уснуть. При передаче
+  // жетона между двумя потоками он обычно появляется за это время.
+  static constexpr int kSpinAttempts = 64;
+
+  bool SpinForToken() {
+    for (int attempt = 0; attempt < kSpinAttempts; ++attempt) {
+      if (TryWait()) {
+        return true;
+      }
+      CpuRelax();
+    }
+    return false;
+  }
+
+  static void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+  }
+
+#if defined(__linux__)
+  // Засыпаем, пока count_ == 0. Ядро само проверяет значение перед тем,
+  // как усыпить поток, поэтому Signal между нашей проверкой и засыпанием
+  // не теряется. Возвращает false, если вышло время.
+  bool Park(const Clock::time_point* deadline) {
+    if (count_.load(std::memory_order_seq_cst) > 0) {
+      return true;
+    }
+    timespec timeout{};
+    timespec* timeout_ptr = nullptr;
+    if (deadline != nullptr) {
+      const auto left = *deadline - Clock::now();
+      if (left <= Clock::duration::zero()) {
+        return false;
+      }
+      const auto seconds =
+          std::chrono::duration_cast<std::chrono::seconds>(left);
+      timeout.tv_sec = static_cast<time_t>(seconds.count());
+      timeout.tv_nsec = static_cast<long>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(
+              left - seconds).count());
+      timeout_ptr = &timeout;
+    }
+    const long result = syscall(SYS_futex, FutexWord(), FUTEX_WAIT_PRIVATE,
+                                0, timeout_ptr, nullptr, 0);
+    return !(result == -1 && errno == ETIMEDOUT);
+  }
+
+  void Wake(const int32_t count) {
+    syscall(SYS_futex, FutexWord(), FUTEX_WAKE_PRIVATE, count, nullptr,
+            nullptr, 0);
+  }
+
+  int32_t* FutexWord() {
+    static_assert(sizeof(std::atomic<int32_t>) == sizeof(int32_t),
+                  "futex needs a plain 32-bit word");
+    return reinterpret_cast<int32_t*>(&count_);
+  }
+#else
+  // Запасной вариант без futex: мьютекс и условная переменная, но только
+  // на медленном пути.
+  bool Park(const Clock::time_point* deadline) {
+    std::unique_lock<std::mutex> locker(park_mutex_);
+    if (count_.load(std::memory_order_seq_cst) > 0) {
+      return true;
+    }
+    if (deadline == nullptr) {
+      park_observer_.wait(locker);
+      return true;
+    }
+    return park_observer_.wait_until(locker, *deadline) ==
+        std::cv_status::no_timeout;
+  }
+
+  void Wake(const int32_t count) {
+    std::unique_lock<std::mutex> locker(park_mutex_);
+    if (count == 1) {
+      park_observer_.notify_one();
+    } else {
+      park_observer_.notify_all();
+    }
+  }
+
+  std::mutex park_mutex_;
+  std::condition_variable park_observer_;
+#endif
+
+  // Количество свободных жетонов.
+  std::atomic<int32_t> count_;
+  // Количество потоков, которые ушли (или собираются уйти) спать.
+  std::atomic<int32_t> sleepers_;
+};
@@ -2,6 +2,8 @@
 // Многопоточная блокирующая очередь.
 // Провилков Иван. группа 593.
 
+#include "../lock_profiler.h"
+
 #include <condition_variable>
 #include <deque>
 #include <exception>
@@ -9,6 +11,7 @@
 #include <iostream>
 #include <mutex>
 #include <string>
+#include <vector>
 
 class BlockingQueueException : public std::exception {
  public:
@@ -22,9 +25,11 @@ class BlockingQueue {
   // Блокирующая очередь фиксированной вместимости.
  public:
   explicit BlockingQueue(const size_t& capacity)
-      : capacity_(capacity), queue_is_working_(true) {}
+      : capacity_(capacity), queue_is_working_(true) {
+    lock_profiler::SetName(mutex_, "BlockingQueue");
+  }
   void Put(T&& element) {
-    std::unique_lock<std::mutex> locker(mutex_);
+    std::unique_lock<Mutex> locker(mutex_);
     put_observer_.wait(locker, [this]() {return !queue_is_working_ ||
         queue_.size() < capacity_;});
     if (!queue_is_working_) {
@@ -33,8 +38,29 @@ class BlockingQueue {
     queue_.push_back(std::move(element));
     get_observer_.notify_one();
   }
+  // Кладет все элементы за один захват мьютекса, если хватает места,
+  // и будит столько потребителей, сколько элементов положено.
+  void PutBatch(std::vector<T>& elements) {
+    std::unique_lock<Mutex> locker(mutex_);
+    for (T& element : elements) {
+      if (queue_is_working_ && queue_.size() >= capacity_) {
+        get_observer_.notify_all();
+        put_observer_.wait(locker, [this]() {return !queue_is_working_ ||
+            queue_.size() < capacity_;});
+      }
+      if (!queue_is_working_) {
+        throw BlockingQueueException("Try put to disabled queue");
+      }
+      queue_.push_back(std::move(element));
+    }
+    if (elements.size() == 1) {
+      get_observer_.notify_one();
+    } else if (elements.size() > 1) {
+      get_observer_.notify_all();
+    }
+  }
   bool Get(T& result) {
-    std::unique_lock<std::mutex> lock(mutex_);
+    std::unique_lock<Mutex> lock(mutex_);
     get_observer_.wait(lock, [this]() {return queue_.size() != 0 ||
         !queue_is_working_;});
     if (!queue_is_working_ && queue_.size() == 0) {
@@ -45,19 +71,46 @@ class BlockingQueue {
     put_observer_.notify_one();
     return true;
   }
+  // Неблокирующий Put: возвращает false, если очередь заполнена, и тогда
+  // element не трогается.
+  bool TryPut(T&& element) {
+    std::unique_lock<Mutex> lock(mutex_);
+    if (!queue_is_working_) {
+      throw BlockingQueueException("Try put to disabled queue");
+    }
+    if (queue_.size() >= capacity_) {
+      return false;
+    }
+    queue_.push_back(std::move(element));
+    get_observer_.notify_one();
+    return true;
+  }
+  // Неблокирующий Get: возвращает false, если очередь пуста.
+  bool TryGet(T& result) {
+    std::unique_lock<Mutex> lock(mutex_);
+    if (queue_.size() == 0) {
+      return false;
+    }
+    result = std::move(queue_.front());
+    queue_.pop_front();
+    put_observer_.notify_one();
+    return true;
+  }
   void Shutdown() {
     // Захватываем мьютекс, так как иначе может оказаться, что мы сделали
     // Shutdown, после того как поток проверил что очередь еще работает, но до
     // того как он встал в wait в функции get, и тогда он так и будет спать.
-    std::unique_lock<std::mutex> lock(mutex_);
+    std::unique_lock<Mutex> lock(mutex_);
     queue_is_working_ = false;
     put_observer_.notify_all();
     get_observer_.notify_all();
   }
  private:
-  std::mutex mutex_;
+  using Mutex = lock_profiler::Profiled<std::mutex>;
+
+  Mutex mutex_;
   size_t capacity_;
   Container queue_;
-  std::condition_variable put_observer_, get_observer_;
+  lock_profiler::ConditionVariableFor<Mutex> put_observer_, get_observer_;
   bool queue_is_working_;
 };
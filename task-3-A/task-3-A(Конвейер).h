@@ -0,0 +1,774 @@
+#pragma once
+// Конвейер из типизированных стадий.
+// Провилков Иван. группа 593.
+//
+// PipelineBuilder<In>().Then(f).Then(g).Sink(h) запускает потоки стадий и
+// возвращает Pipeline<In>, в который элементы кладутся через Push. Между
+// стадиями стоят ограниченные связи, так что быстрый источник упирается в
+// медленную стадию (backpressure). Если с обеих сторон связи по одному
+// потоку, связь - кольцевой буфер без блокировок для одного производителя
+// и одного потребителя: передача элемента - запись и release-store
+// индекса. Если потоков больше, связь - BlockingQueue.
+//
+// Элементы нумеруются при входе в конвейер. Упорядоченная стадия выдает
+// результаты в порядке номеров, придерживая обогнавшие; неупорядоченная -
+// как получилось. Конец потока распространяется как Shutdown у
+// BlockingQueue: Close закрывает вход, стадия, дочитав вход, закрывает
+// свой выход. Исключение стадии закрывает все связи, оставшиеся элементы
+// выбрасываются, а Wait бросает его дальше.
+
+#include "task-3-A(Блокирующая очередь).h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+struct StageOptions {
+  // Сколько потоков выполняют стадию. Если больше одного, функция стадии
+  // вызывается одновременно из нескольких потоков.
+  size_t parallelism = 1;
+  // Выдавать результаты в порядке входа элементов в конвейер.
+  bool ordered = true;
+  // Вместимость связи перед стадией.
+  size_t capacity = 1024;
+};
+
+struct PipelineOptions {
+  // Push зовут несколько потоков: первая связь тогда многопоточная.
+  bool multiple_producers = false;
+  // Сколько элементов может одновременно находиться внутри конвейера;
+  // 0 - сколько поместится в связи. Ограничивает и элементы, которые
+  // упорядоченные стадии придерживают, ожидая отставший.
+  size_t max_in_flight = 0;
+};
+
+// Кольцевой буфер для одного производителя и одного потребителя. TryPush
+// и TryPop без ожидания: каждый конец пишет только свой индекс, а чужой
+// перечитывает, только когда по сохраненному значению буфер полон (пуст).
+template <class T>
+class SpscRingBuffer {
+ public:
+  explicit SpscRingBuffer(size_t capacity)
+      : mask_(RoundUpToPowerOfTwo(std::max<size_t>(capacity, 1)) - 1),
+        slots_(new Slot[mask_ + 1]) {}
+
+  SpscRingBuffer(const SpscRingBuffer&) = delete;
+  SpscRingBuffer& operator=(const SpscRingBuffer&) = delete;
+
+  ~SpscRingBuffer() {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    for (size_t head = head_.load(std::memory_order_relaxed); head != tail;
+         ++head) {
+      slots_[head & mask_].Value()->~T();
+    }
+  }
+
+  // Только производитель. При неудаче value не трогается.
+  bool TryPush(T&& value) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cached_head_ > mask_) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+      if (tail - cached_head_ > mask_) {
+        return false;
+      }
+    }
+    new (slots_[tail & mask_].storage) T(std::move(value));
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Только потребитель.
+  bool TryPop(T& result) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == cached_tail_) {
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+      if (head == cached_tail_) {
+        return false;
+      }
+    }
+    T* value = slots_[head & mask_].Value();
+    result = std::move(*value);
+    value->~T();
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Только производитель.
+  bool Full() const {
+    return tail_.load(std::memory_order_relaxed) -
+        head_.load(std::memory_order_acquire) > mask_;
+  }
+
+  // Только потребитель.
+  bool Empty() const {
+    return head_.load(std::memory_order_relaxed) ==
+        tail_.load(std::memory_order_acquire);
+  }
+
+  size_t Capacity() const {
+    return mask_ + 1;
+  }
+
+ private:
+  struct Slot {
+    T* Value() {
+      return std::launder(reinterpret_cast<T*>(storage));
+    }
+
+    alignas(T) unsigned char storage[sizeof(T)];
+  };
+
+  static size_t RoundUpToPowerOfTwo(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+      result <<= 1;
+    }
+    return result;
+  }
+
+  // Индекс и кэш чужого индекса каждого конца в своей кэш-линии.
+  alignas(64) std::atomic<size_t> tail_{0};
+  size_t cached_head_ = 0;
+  alignas(64) std::atomic<size_t> head_{0};
+  size_t cached_tail_ = 0;
+  alignas(64) const size_t mask_;
+  std::unique_ptr<Slot[]> slots_;
+};
+
+namespace pipeline_detail {
+
+inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  _mm_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield" ::: "memory");
+#endif
+}
+
+// Ожидание перед сном: сначала короткие паузы процессора, потом yield,
+// чтобы другой конец связи успел поработать, если ядер меньше, чем
+// потоков.
+constexpr int kSpinAttempts = 16;
+constexpr int kYieldAttempts = 64;
+
+// false - пора засыпать.
+inline bool Backoff(int attempt) {
+  if (attempt < kSpinAttempts) {
+    CpuRelax();
+    return true;
+  }
+  if (attempt < kYieldAttempts) {
+    std::this_thread::yield();
+    return true;
+  }
+  return false;
+}
+
+// Место, где засыпают ждущие условия. Будящий трогает мьютекс, только
+// если кто-то спит.
+class Parking {
+ public:
+  template <class Ready>
+  void Wait(Ready ready) {
+    std::unique_lock<std::mutex> locker(mutex_);
+    sleepers_.fetch_add(1, std::memory_order_seq_cst);
+    while (!ready()) {
+      observer_.wait(locker);
+    }
+    sleepers_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  // Звать после изменения, которое может сделать условие истинным. Чтение
+  // через RMW: либо видим увеличение sleepers_, либо заснувший после нас
+  // увидит изменение.
+  void Notify() {
+    if (sleepers_.fetch_add(0, std::memory_order_seq_cst) == 0) {
+      return;
+    }
+    std::lock_guard<std::mutex> locker(mutex_);
+    observer_.notify_one();
+  }
+
+  void WakeAll() {
+    std::lock_guard<std::mutex> locker(mutex_);
+    observer_.notify_all();
+  }
+
+ private:
+  alignas(64) std::atomic<size_t> sleepers_{0};
+  std::mutex mutex_;
+  std::condition_variable observer_;
+};
+
+template <class T>
+struct Item {
+  uint64_t sequence;
+  T value;
+};
+
+class LinkBase {
+ public:
+  virtual ~LinkBase() = default;
+  // После Close Put возвращает false, а Get отдает оставшееся и потом
+  // возвращает false.
+  virtual void Close() = 0;
+};
+
+template <class T>
+class Link : public LinkBase {
+ public:
+  // Ждет места. false, если связь закрыта.
+  virtual bool Put(T&& element) = 0;
+  // Ждет элемента. false, если связь закрыта и пуста.
+  virtual bool Get(T& result) = 0;
+};
+
+template <class T>
+class SpscLink : public Link<T> {
+ public:
+  explicit SpscLink(size_t capacity) : ring_(capacity) {}
+
+  bool Put(T&& element) override {
+    for (int attempt = 0;; ++attempt) {
+      if (closed_.load(std::memory_order_acquire)) {
+        return false;
+      }
+      if (ring_.TryPush(std::move(element))) {
+        not_empty_.Notify();
+        return true;
+      }
+      if (Backoff(attempt)) {
+        continue;
+      }
+      not_full_.Wait([this]() {
+        return closed_.load(std::memory_order_acquire) || !ring_.Full();
+      });
+    }
+  }
+
+  bool Get(T& result) override {
+    for (int attempt = 0;; ++attempt) {
+      if (ring_.TryPop(result)) {
+        not_full_.Notify();
+        return true;
+      }
+      if (closed_.load(std::memory_order_acquire)) {
+        // Производитель мог положить элемент перед тем, как закрыть.
+        return ring_.TryPop(result);
+      }
+      if (Backoff(attempt)) {
+        continue;
+      }
+      not_empty_.Wait([this]() {
+        return closed_.load(std::memory_order_acquire) || !ring_.Empty();
+      });
+    }
+  }
+
+  void Close() override {
+    closed_.store(true, std::memory_order_release);
+    not_empty_.WakeAll();
+    not_full_.WakeAll();
+  }
+
+ private:
+  SpscRingBuffer<T> ring_;
+  std::atomic<bool> closed_{false};
+  Parking not_empty_;
+  Parking not_full_;
+};
+
+template <class T>
+class MpmcLink : public Link<T> {
+ public:
+  explicit MpmcLink(size_t capacity)
+      : queue_(std::max<size_t>(capacity, 1)) {}
+
+  bool Put(T&& element) override {
+    try {
+      queue_.Put(std::move(element));
+      return true;
+    } catch (const BlockingQueueException&) {
+      return false;
+    }
+  }
+
+  bool Get(T& result) override {
+    return queue_.Get(result);
+  }
+
+  void Close() override {
+    queue_.Shutdown();
+  }
+
+ private:
+  BlockingQueue<T> queue_;
+};
+
+// Связь между producers и consumers потоками.
+template <class T>
+std::shared_ptr<Link<T> > MakeLink(size_t producers, size_t consumers,
+                                   size_t capacity) {
+  if (producers == 1 && consumers == 1) {
+    return std::make_shared<SpscLink<T> >(capacity);
+  }
+  return std::make_shared<MpmcLink<T> >(capacity);
+}
+
+// Ограничение числа элементов внутри конвейера.
+class InFlightLimit {
+ public:
+  explicit InFlightLimit(size_t limit) : limit_(limit) {}
+
+  bool Acquire() {
+    if (limit_ == 0) {
+      return true;
+    }
+    for (int attempt = 0;; ++attempt) {
+      if (closed_.load(std::memory_order_acquire)) {
+        return false;
+      }
+      size_t current = in_flight_.load(std::memory_order_relaxed);
+      if (current < limit_ &&
+          in_flight_.compare_exchange_weak(current, current + 1,
+                                           std::memory_order_relaxed)) {
+        return true;
+      }
+      if (Backoff(attempt)) {
+        continue;
+      }
+      released_.Wait([this]() {
+        return closed_.load(std::memory_order_acquire) ||
+            in_flight_.load(std::memory_order_relaxed) < limit_;
+      });
+    }
+  }
+
+  void Release() {
+    if (limit_ == 0) {
+      return;
+    }
+    in_flight_.fetch_sub(1, std::memory_order_relaxed);
+    released_.Notify();
+  }
+
+  void Close() {
+    closed_.store(true, std::memory_order_release);
+    released_.WakeAll();
+  }
+
+ private:
+  const size_t limit_;
+  alignas(64) std::atomic<size_t> in_flight_{0};
+  std::atomic<bool> closed_{false};
+  Parking released_;
+};
+
+// Общее состояние конвейера: потоки стадий, связи, первая ошибка.
+class Graph {
+ public:
+  explicit Graph(const PipelineOptions& options)
+      : limit(options.max_in_flight) {}
+
+  Graph(const Graph&) = delete;
+  Graph& operator=(const Graph&) = delete;
+
+  void AddLink(std::shared_ptr<LinkBase> link) {
+    links_.push_back(std::move(link));
+  }
+
+  void AddWorker(std::function<void()> worker) {
+    workers_.push_back(std::move(worker));
+  }
+
+  void Start() {
+    try {
+      for (std::function<void()>& worker : workers_) {
+        threads_.emplace_back(std::move(worker));
+      }
+    } catch (...) {
+      Fail(std::current_exception());
+      Join();
+      throw;
+    }
+    workers_.clear();
+  }
+
+  void Join() {
+    std::lock_guard<std::mutex> locker(join_mutex_);
+    for (std::thread& thread : threads_) {
+      if (thread.joinable()) {
+        thread.join();
+      }
+    }
+  }
+
+  uint64_t NextSequence() {
+    return sequence_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Запоминает первую ошибку и закрывает все связи.
+  void Fail(std::exception_ptr error) {
+    {
+      std::lock_guard<std::mutex> locker(error_mutex_);
+      if (error_ == nullptr) {
+        error_ = std::move(error);
+      }
+    }
+    failed_.store(true, std::memory_order_release);
+    limit.Close();
+    for (const std::shared_ptr<LinkBase>& link : links_) {
+      link->Close();
+    }
+  }
+
+  bool Failed() const {
+    return failed_.load(std::memory_order_acquire);
+  }
+
+  std::exception_ptr Error() {
+    std::lock_guard<std::mutex> locker(error_mutex_);
+    return error_;
+  }
+
+  InFlightLimit limit;
+
+ private:
+  std::vector<std::shared_ptr<LinkBase> > links_;
+  std::vector<std::function<void()> > workers_;
+  std::vector<std::thread> threads_;
+  std::mutex join_mutex_;
+  alignas(64) std::atomic<uint64_t> sequence_{0};
+  std::atomic<bool> failed_{false};
+  std::mutex error_mutex_;
+  std::exception_ptr error_;
+};
+
+// Выдает элементы в порядке номеров, придерживая обогнавшие.
+template <class T>
+class Reorderer {
+ public:
+  explicit Reorderer(bool concurrent) : concurrent_(concurrent) {}
+
+  // emit(Item<T>&&) возвращает false, если выход закрыт.
+  template <class Emit>
+  bool Push(Item<T>&& item, Emit& emit) {
+    std::unique_lock<std::mutex> locker(mutex_, std::defer_lock);
+    if (concurrent_) {
+      locker.lock();
+    }
+    if (item.sequence != next_) {
+      pending_.emplace(item.sequence, std::move(item.value));
+      return true;
+    }
+    ++next_;
+    if (!emit(std::move(item))) {
+      return false;
+    }
+    return EmitReady(emit);
+  }
+
+  // Конец потока: выдает придержанное, пропуская номера, которые так и не
+  // пришли (Push, проигравший гонку с Close).
+  template <class Emit>
+  void Flush(Emit& emit) {
+    while (!pending_.empty()) {
+      next_ = pending_.begin()->first;
+      if (!EmitReady(emit)) {
+        return;
+      }
+    }
+  }
+
+ private:
+  template <class Emit>
+  bool EmitReady(Emit& emit) {
+    for (auto it = pending_.begin();
+         it != pending_.end() && it->first == next_; ) {
+      Item<T> ready{next_++, std::move(it->second)};
+      it = pending_.erase(it);
+      if (!emit(std::move(ready))) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  const bool concurrent_;
+  std::mutex mutex_;
+  uint64_t next_ = 0;
+  std::map<uint64_t, T> pending_;
+};
+
+template <class In, class Out, class Function>
+class TransformStage {
+ public:
+  TransformStage(Graph& graph, std::shared_ptr<Link<Item<In> > > input,
+                 std::shared_ptr<Link<Item<Out> > > output,
+                 Function function, const StageOptions& options)
+      : graph_(graph), input_(std::move(input)), output_(std::move(output)),
+        function_(std::move(function)), ordered_(options.ordered),
+        reorderer_(options.parallelism > 1), running_(options.parallelism) {}
+
+  void Work() {
+    auto emit = [this](Item<Out>&& item) {
+      return output_->Put(std::move(item));
+    };
+    Item<In> item{};
+    while (input_->Get(item)) {
+      if (graph_.Failed()) {
+        continue;
+      }
+      try {
+        Item<Out> result{item.sequence, function_(std::move(item.value))};
+        if (ordered_) {
+          reorderer_.Push(std::move(result), emit);
+        } else {
+          emit(std::move(result));
+        }
+      } catch (...) {
+        graph_.Fail(std::current_exception());
+      }
+    }
+    if (running_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      if (ordered_ && !graph_.Failed()) {
+        reorderer_.Flush(emit);
+      }
+      output_->Close();
+    }
+  }
+
+ private:
+  Graph& graph_;
+  std::shared_ptr<Link<Item<In> > > input_;
+  std::shared_ptr<Link<Item<Out> > > output_;
+  Function function_;
+  const bool ordered_;
+  Reorderer<Out> reorderer_;
+  std::atomic<size_t> running_;
+};
+
+template <class In, class Function>
+class SinkStage {
+ public:
+  SinkStage(Graph& graph, std::shared_ptr<Link<Item<In> > > input,
+            Function function, const StageOptions& options)
+      : graph_(graph), input_(std::move(input)),
+        function_(std::move(function)), ordered_(options.ordered),
+        reorderer_(options.parallelism > 1), running_(options.parallelism) {}
+
+  void Work() {
+    auto emit = [this](Item<In>&& item) {
+      function_(std::move(item.value));
+      graph_.limit.Release();
+      return true;
+    };
+    Item<In> item{};
+    while (input_->Get(item)) {
+      if (graph_.Failed()) {
+        continue;
+      }
+      try {
+        if (ordered_) {
+          reorderer_.Push(std::move(item), emit);
+        } else {
+          emit(std::move(item));
+        }
+      } catch (...) {
+        graph_.Fail(std::current_exception());
+      }
+    }
+    if (running_.fetch_sub(1, std::memory_order_acq_rel) == 1 && ordered_ &&
+        !graph_.Failed()) {
+      try {
+        reorderer_.Flush(emit);
+      } catch (...) {
+        graph_.Fail(std::current_exception());
+      }
+    }
+  }
+
+ private:
+  Graph& graph_;
+  std::shared_ptr<Link<Item<In> > > input_;
+  Function function_;
+  const bool ordered_;
+  Reorderer<In> reorderer_;
+  std::atomic<size_t> running_;
+};
+
+}  // namespace pipeline_detail
+
+template <class In>
+class Pipeline {
+ public:
+  Pipeline(Pipeline&&) = default;
+  Pipeline& operator=(Pipeline&&) = delete;
+
+  // Закрывает вход и ждет стадии; ошибку стадии при этом не бросает.
+  ~Pipeline() {
+    if (graph_ != nullptr) {
+      Close();
+      graph_->Join();
+    }
+  }
+
+  // Кладет элемент, ждет, если связь перед первой стадией заполнена.
+  // Возвращает false, если конвейер закрыт или стадия бросила исключение.
+  bool Push(In value) {
+    if (!graph_->limit.Acquire()) {
+      return false;
+    }
+    if (input_->Put(pipeline_detail::Item<In>{graph_->NextSequence(),
+                                              std::move(value)})) {
+      return true;
+    }
+    graph_->limit.Release();
+    return false;
+  }
+
+  // Конец потока. Элементы, уже положенные в конвейер, будут обработаны.
+  void Close() {
+    input_->Close();
+  }
+
+  // Ждет, пока стадии обработают все до конца потока (то есть вызывать
+  // после Close), и бросает первое исключение стадии.
+  void Wait() {
+    graph_->Join();
+    if (std::exception_ptr error = graph_->Error()) {
+      std::rethrow_exception(error);
+    }
+  }
+
+ private:
+  template <class, class>
+  friend class PipelineBuilder;
+
+  Pipeline(std::shared_ptr<pipeline_detail::Graph> graph,
+           std::shared_ptr<pipeline_detail::Link<pipeline_detail::Item<In> > >
+               input)
+      : graph_(std::move(graph)), input_(std::move(input)) {}
+
+  std::shared_ptr<pipeline_detail::Graph> graph_;
+  std::shared_ptr<pipeline_detail::Link<pipeline_detail::Item<In> > > input_;
+};
+
+// Строит конвейер со входом In; Out - тип результата последней стадии.
+// Стадии добавляются по цепочке, каждый вызов потребляет построитель:
+//   Pipeline<int> pipeline = PipelineBuilder<int>()
+//       .Then([](int x) { return x * x; }, parallel)
+//       .Sink([&](int x) { sum += x; });
+// Типы элементов должны конструироваться по умолчанию, как у
+// BlockingQueue.
+template <class In, class Out = In>
+class PipelineBuilder {
+ public:
+  explicit PipelineBuilder(const PipelineOptions& options = PipelineOptions())
+      : graph_(std::make_shared<pipeline_detail::Graph>(options)),
+        input_(std::make_shared<InputSlot>()),
+        producers_(options.multiple_producers ? 0 : 1) {
+    static_assert(std::is_same<In, Out>::value,
+                  "PipelineBuilder starts with Out = In");
+    std::shared_ptr<InputSlot> input = input_;
+    connect_ = [input](std::shared_ptr<OutputLink> link) {
+      *input = std::move(link);
+    };
+  }
+
+  // Добавляет стадию Next function(Out).
+  template <class Function>
+  PipelineBuilder<In, std::decay_t<std::invoke_result_t<Function&, Out> > >
+  Then(Function function, const StageOptions& options = StageOptions()) && {
+    using Next = std::decay_t<std::invoke_result_t<Function&, Out> >;
+    using Stage = pipeline_detail::TransformStage<Out, Next, Function>;
+    std::shared_ptr<OutputLink> input = Connect(options);
+    pipeline_detail::Graph* graph = graph_.get();
+    const size_t parallelism = std::max<size_t>(options.parallelism, 1);
+    StageOptions stage_options = options;
+    stage_options.parallelism = parallelism;
+    auto connect = [graph, input, function = std::move(function),
+                    stage_options](
+        std::shared_ptr<pipeline_detail::Link<pipeline_detail::Item<Next> > >
+            output) mutable {
+      auto stage = std::make_shared<Stage>(*graph, input, std::move(output),
+                                           std::move(function),
+                                           stage_options);
+      for (size_t worker = 0; worker < stage_options.parallelism; ++worker) {
+        graph->AddWorker([stage]() {
+          stage->Work();
+        });
+      }
+    };
+    return PipelineBuilder<In, Next>(std::move(graph_), std::move(input_),
+                                     std::move(connect), parallelism);
+  }
+
+  // Последняя стадия: function(Out) для каждого элемента. Запускает потоки
+  // всех стадий.
+  template <class Function>
+  Pipeline<In> Sink(Function function,
+                    const StageOptions& options = StageOptions()) && {
+    using Stage = pipeline_detail::SinkStage<Out, Function>;
+    std::shared_ptr<OutputLink> input = Connect(options);
+    StageOptions stage_options = options;
+    stage_options.parallelism = std::max<size_t>(options.parallelism, 1);
+    auto stage = std::make_shared<Stage>(*graph_, input, std::move(function),
+                                         stage_options);
+    for (size_t worker = 0; worker < stage_options.parallelism; ++worker) {
+      graph_->AddWorker([stage]() {
+        stage->Work();
+      });
+    }
+    graph_->Start();
+    return Pipeline<In>(std::move(graph_), std::move(*input_));
+  }
+
+ private:
+  template <class, class>
+  friend class PipelineBuilder;
+
+  using InputSlot =
+      std::shared_ptr<pipeline_detail::Link<pipeline_detail::Item<In> > >;
+  using OutputLink = pipeline_detail::Link<pipeline_detail::Item<Out> >;
+  using Connector = std::function<void(std::shared_ptr<OutputLink>)>;
+
+  PipelineBuilder(std::shared_ptr<pipeline_detail::Graph> graph,
+                  std::shared_ptr<InputSlot> input, Connector connect,
+                  size_t producers)
+      : graph_(std::move(graph)), input_(std::move(input)),
+        connect_(std::move(connect)), producers_(producers) {}
+
+  // Создает связь между последней стадией и новой и отдает ее последней.
+  // producers_ == 0 - сколько угодно производителей.
+  std::shared_ptr<OutputLink> Connect(const StageOptions& options) {
+    std::shared_ptr<OutputLink> link =
+        pipeline_detail::MakeLink<pipeline_detail::Item<Out> >(
+            producers_, std::max<size_t>(options.parallelism, 1),
+            options.capacity);
+    graph_->AddLink(link);
+    connect_(link);
+    return link;
+  }
+
+  std::shared_ptr<pipeline_detail::Graph> graph_;
+  std::shared_ptr<InputSlot> input_;
+  Connector connect_;
+  size_t producers_;
+};
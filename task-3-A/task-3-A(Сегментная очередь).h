@@ -0,0 +1,497 @@
+#pragma once
+// Неограниченная lock-free MPMC очередь из сегментов.
+// Провилков Иван. группа 593.
+//
+// Очередь - список сегментов по kSegmentSize ячеек. Производитель берет
+// номер ячейки в хвостовом сегменте через fetch_add, потребитель - в
+// головном, так что в обычном случае операция - один fetch_add и одна
+// exchange без циклов CAS. У ячейки три состояния: EMPTY, FULL и TAKEN.
+// Производитель кладет значение и переводит EMPTY -> FULL; потребитель
+// делает exchange(TAKEN): если там было FULL, значение его, если EMPTY -
+// производитель опоздал, увидит TAKEN и возьмет другую ячейку.
+//
+// Сегмент, который прочитали до конца, снимается с головы и
+// возвращается в список свободных (под мьютексом, это событие раз на
+// kSegmentSize операций), когда на него не смотрит ни один поток. Поток
+// объявляет сегмент, с которым работает, в своем указателе опасности
+// (hazard pointer): это запись в собственную кэш-линию, а не общий
+// счетчик ссылок, который гонял бы линию между ядрами на каждой
+// операции.
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace segmented_queue_detail {
+
+// Указатель опасности потока. Записи общие для всех очередей, живут до
+// конца программы и переходят к новым потокам, когда их поток
+// завершается.
+struct alignas(64) HazardRecord {
+  std::atomic<const void*> pointer{nullptr};
+  std::atomic<bool> active{false};
+  HazardRecord* next = nullptr;
+};
+
+inline std::atomic<HazardRecord*>& HazardRecords() {
+  static std::atomic<HazardRecord*> head{nullptr};
+  return head;
+}
+
+inline HazardRecord* AcquireHazardRecord() {
+  std::atomic<HazardRecord*>& head = HazardRecords();
+  for (HazardRecord* record = head.load(std::memory_order_acquire);
+       record != nullptr; record = record->next) {
+    bool expected = false;
+    if (!record->active.load(std::memory_order_relaxed) &&
+        record->active.compare_exchange_strong(expected, true,
+                                               std::memory_order_acquire)) {
+      return record;
+    }
+  }
+  HazardRecord* record = new HazardRecord();
+  record->active.store(true, std::memory_order_relaxed);
+  record->next = head.load(std::memory_order_relaxed);
+  while (!head.compare_exchange_weak(record->next, record,
+                                     std::memory_order_release,
+                                     std::memory_order_relaxed)) {
+  }
+  return record;
+}
+
+inline HazardRecord& ThisThreadHazard() {
+  struct Holder {
+    HazardRecord* record = AcquireHazardRecord();
+    ~Holder() {
+      record->pointer.store(nullptr, std::memory_order_release);
+      record->active.store(false, std::memory_order_release);
+    }
+  };
+  static thread_local Holder holder;
+  return *holder.record;
+}
+
+}  // namespace segmented_queue_detail
+
+// Значение хранится в ячейке; операции не вызывают чужого кода, кроме
+// перемещающих конструкторов и деструкторов T (деструкторы вызываются
+// только у перемещенных объектов), и те не должны сами работать с
+// SegmentedQueue: у потока один указатель опасности.
+template <class T>
+class SegmentedQueue {
+ public:
+  static constexpr size_t kSegmentSize = 1024;
+
+  SegmentedQueue() {
+    Segment* segment = new Segment();
+    head_.store(segment, std::memory_order_relaxed);
+    tail_.store(segment, std::memory_order_relaxed);
+  }
+
+  SegmentedQueue(const SegmentedQueue&) = delete;
+  SegmentedQueue& operator=(const SegmentedQueue&) = delete;
+
+  ~SegmentedQueue() {
+    // Оставшиеся значения разрушаем прямо в ячейках, не вынимая: от T
+    // не требуется ни конструктора по умолчанию, ни присваивания.
+    Segment* segment = head_.load(std::memory_order_relaxed);
+    while (segment != nullptr) {
+      for (Cell& cell : segment->cells) {
+        if (cell.state.load(std::memory_order_relaxed) == kFull) {
+          cell.Value()->~T();
+        }
+      }
+      Segment* next = segment->next.load(std::memory_order_relaxed);
+      delete segment;
+      segment = next;
+    }
+    for (Segment* retired : retired_segments_) {
+      delete retired;
+    }
+    for (Segment* free_segment : free_segments_) {
+      delete free_segment;
+    }
+  }
+
+  void Push(T value) {
+    while (true) {
+      Segment* tail = Protect(tail_);
+      const size_t index =
+          tail->enqueue_index.fetch_add(1, std::memory_order_relaxed);
+      if (index < kSegmentSize) {
+        Cell& cell = tail->cells[index];
+        new (&cell.storage) T(std::move(value));
+        uint32_t expected = kEmpty;
+        if (cell.state.compare_exchange_strong(expected, kFull,
+                                               std::memory_order_release,
+                                               std::memory_order_relaxed)) {
+          Release();
+          return;
+        }
+        // Потребитель уже пометил ячейку как пропущенную: забираем
+        // значение обратно и пробуем следующую.
+        value = std::move(*cell.Value());
+        cell.Value()->~T();
+        Release();
+        continue;
+      }
+      // Сегмент заполнен: добавляем новый или помогаем сдвинуть хвост.
+      Segment* next = tail->next.load(std::memory_order_acquire);
+      if (next == nullptr) {
+        Segment* segment = AllocateSegment();
+        if (tail->next.compare_exchange_strong(next, segment,
+                                               std::memory_order_acq_rel)) {
+          next = segment;
+        } else {
+          FreeSegment(segment);
+        }
+      }
+      Segment* expected = tail;
+      tail_.compare_exchange_strong(expected, next,
+                                    std::memory_order_acq_rel);
+      Release();
+    }
+  }
+
+  bool TryPop(T& result) {
+    while (true) {
+      Segment* head = Protect(head_);
+      if (head->dequeue_index.load(std::memory_order_acquire) >=
+              head->enqueue_index.load(std::memory_order_acquire) &&
+          head->next.load(std::memory_order_acquire) == nullptr) {
+        Release();
+        return false;
+      }
+      const size_t index =
+          head->dequeue_index.fetch_add(1, std::memory_order_acq_rel);
+      if (index < kSegmentSize) {
+        Cell& cell = head->cells[index];
+        if (cell.state.exchange(kTaken, std::memory_order_acquire) ==
+            kFull) {
+          result = std::move(*cell.Value());
+          cell.Value()->~T();
+          Release();
+          return true;
+        }
+        // Производитель взял ячейку, но еще не положил значение: он
+        // переложит его в другую ячейку.
+        Release();
+        continue;
+      }
+      Segment* next = head->next.load(std::memory_order_acquire);
+      if (next == nullptr) {
+        Release();
+        return false;
+      }
+      // Хвост не должен остаться на сегменте, который мы снимаем.
+      Segment* expected = head;
+      tail_.compare_exchange_strong(expected, next,
+                                    std::memory_order_acq_rel);
+      expected = head;
+      if (head_.compare_exchange_strong(expected, next,
+                                        std::memory_order_acq_rel)) {
+        Retire(head);
+      }
+      Release();
+    }
+  }
+
+  static void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+  }
+
+ private:
+  static constexpr uint32_t kEmpty = 0;
+  static constexpr uint32_t kFull = 1;
+  static constexpr uint32_t kTaken = 2;
+
+  struct Cell {
+    std::atomic<uint32_t> state{kEmpty};
+    alignas(T) unsigned char storage[sizeof(T)];
+
+    T* Value() {
+      return std::launder(reinterpret_cast<T*>(&storage));
+    }
+  };
+
+  struct Segment {
+    alignas(64) std::atomic<size_t> enqueue_index{0};
+    alignas(64) std::atomic<size_t> dequeue_index{0};
+    alignas(64) std::atomic<Segment*> next{nullptr};
+    Cell cells[kSegmentSize];
+
+    // Сегмент из списка свободных: никто его не держит, ячейки пусты.
+    void Reset() {
+      enqueue_index.store(0, std::memory_order_relaxed);
+      dequeue_index.store(0, std::memory_order_relaxed);
+      next.store(nullptr, std::memory_order_relaxed);
+      for (Cell& cell : cells) {
+        cell.state.store(kEmpty, std::memory_order_relaxed);
+      }
+    }
+  };
+
+  // Объявляет сегмент, на который сейчас указывает pointer, опасным,
+  // чтобы его не переиспользовали, пока поток с ним работает.
+  static Segment* Protect(std::atomic<Segment*>& pointer) {
+    std::atomic<const void*>& hazard =
+        segmented_queue_detail::ThisThreadHazard().pointer;
+    Segment* segment = pointer.load(std::memory_order_acquire);
+    while (true) {
+      hazard.store(segment, std::memory_order_seq_cst);
+      Segment* current = pointer.load(std::memory_order_seq_cst);
+      if (current == segment) {
+        return segment;
+      }
+      segment = current;
+    }
+  }
+
+  static void Release() {
+    segmented_queue_detail::ThisThreadHazard().pointer.store(
+        nullptr, std::memory_order_release);
+  }
+
+  // Сегмент снят с головы. Вместе с ним проверяем и ранее снятые: те, на
+  // которые не смотрит ни один поток, уходят в список свободных. Сам
+  // снимающий поток еще держит сегмент, так что он дождется следующего
+  // раза.
+  void Retire(Segment* segment) {
+    // Снимок указателей опасности берется под мьютексом: иначе за время
+    // ожидания мьютекса снятый сегмент мог бы уйти в свободные, снова
+    // стать хвостом, получить новый указатель опасности и быть снятым
+    // еще раз, а старый снимок об этом указателе не знает.
+    std::lock_guard<std::mutex> locker(free_mutex_);
+    std::vector<const void*> hazards;
+    for (segmented_queue_detail::HazardRecord* record =
+             segmented_queue_detail::HazardRecords().load(
+                 std::memory_order_acquire);
+         record != nullptr; record = record->next) {
+      if (const void* pointer =
+              record->pointer.load(std::memory_order_seq_cst)) {
+        hazards.push_back(pointer);
+      }
+    }
+    retired_segments_.push_back(segment);
+    size_t kept = 0;
+    for (Segment* retired : retired_segments_) {
+      if (std::find(hazards.begin(), hazards.end(), retired) !=
+          hazards.end()) {
+        retired_segments_[kept++] = retired;
+      } else {
+        free_segments_.push_back(retired);
+      }
+    }
+    retired_segments_.resize(kept);
+  }
+
+  Segment* AllocateSegment() {
+    {
+      std::lock_guard<std::mutex> locker(free_mutex_);
+      if (!free_segments_.empty()) {
+        Segment* segment = free_segments_.back();
+        free_segments_.pop_back();
+        segment->Reset();
+        return segment;
+      }
+    }
+    return new Segment();
+  }
+
+  // Новый сегмент, который не пригодился.
+  void FreeSegment(Segment* segment) {
+    std::lock_guard<std::mutex> locker(free_mutex_);
+    free_segments_.push_back(segment);
+  }
+
+  alignas(64) std::atomic<Segment*> head_;
+  alignas(64) std::atomic<Segment*> tail_;
+  alignas(64) std::mutex free_mutex_;
+  std::vector<Segment*> retired_segments_;
+  std::vector<Segment*> free_segments_;
+};
+
+// Блокирующая обертка над SegmentedQueue с интерфейсом BlockingQueue, но
+// без ограничения вместимости. Put и TryGet не берут мьютексов; Get
+// сначала недолго крутится, а потом засыпает на условной переменной.
+// Put трогает мьютекс, только если кто-то спит.
+template <class T>
+class BlockingSegmentedQueue {
+ public:
+  BlockingSegmentedQueue() = default;
+
+  // Возвращает false, если очередь уже закрыта.
+  bool Put(T&& element) {
+    if (!BeginPut()) {
+      return false;
+    }
+    queue_.Push(std::move(element));
+    WakeSleepers(false);
+    EndPut();
+    return true;
+  }
+
+  bool PutBatch(std::vector<T>& elements) {
+    if (!BeginPut()) {
+      return false;
+    }
+    for (T& element : elements) {
+      queue_.Push(std::move(element));
+    }
+    WakeSleepers(elements.size() > 1);
+    EndPut();
+    return true;
+  }
+
+  bool TryGet(T& result) {
+    return queue_.TryPop(result);
+  }
+
+  // Возвращает false, если очередь закрыта и пуста.
+  bool Get(T& result) {
+    return Wait(result, nullptr);
+  }
+
+  // Как Get, но возвращает false и тогда, когда спящего разбудили через
+  // Interrupt; в этом случае interrupted = true.
+  bool Get(T& result, bool& interrupted) {
+    interrupted = false;
+    return Wait(result, &interrupted);
+  }
+
+  // Будит одного потока, спящего в Get(result, interrupted), хотя
+  // элементов нет: например, чтобы он поискал работу в другом месте.
+  // Возвращает false, если спящих нет.
+  bool Interrupt() {
+    if (sleepers_.fetch_add(0, std::memory_order_seq_cst) == 0) {
+      return false;
+    }
+    std::lock_guard<std::mutex> locker(mutex_);
+    // Больше прерываний, чем спящих, не копим.
+    if (interrupts_ < sleepers_.load(std::memory_order_relaxed)) {
+      ++interrupts_;
+    }
+    observer_.notify_all();
+    return true;
+  }
+
+  // После возврата новые Put не проходят, а начатые до закрытия уже
+  // положили свои элементы.
+  void Shutdown() {
+    {
+      std::lock_guard<std::mutex> locker(mutex_);
+      closed_.store(true, std::memory_order_seq_cst);
+      observer_.notify_all();
+    }
+    while (putters_.load(std::memory_order_seq_cst) != 0) {
+      std::this_thread::yield();
+    }
+  }
+
+ private:
+  static constexpr int kSpinAttempts = 64;
+
+  // Проверка closed_ и вставка в Put не атомарны с Shutdown, поэтому
+  // идущие вставки считаются в putters_. Пара seq_cst операций с двух
+  // сторон (putters_ и closed_) гарантирует: либо Put увидит закрытие и
+  // откажет, либо тот, кто увидел закрытие, увидит и putters_ != 0.
+  bool BeginPut() {
+    putters_.fetch_add(1, std::memory_order_seq_cst);
+    if (closed_.load(std::memory_order_seq_cst)) {
+      EndPut();
+      return false;
+    }
+    return true;
+  }
+
+  void EndPut() {
+    putters_.fetch_sub(1, std::memory_order_seq_cst);
+    // Get закрытой очереди может ждать, пока мы закончим.
+    if (closed_.load(std::memory_order_seq_cst)) {
+      std::lock_guard<std::mutex> locker(mutex_);
+      observer_.notify_all();
+    }
+  }
+
+  // Закрыта, и ни одна начатая вставка уже не положит элемент.
+  bool Drained() const {
+    return closed_.load(std::memory_order_seq_cst) &&
+        putters_.load(std::memory_order_seq_cst) == 0;
+  }
+
+  bool Wait(T& result, bool* interrupted) {
+    for (int attempt = 0; attempt < kSpinAttempts; ++attempt) {
+      if (queue_.TryPop(result)) {
+        return true;
+      }
+      if (closed_.load(std::memory_order_acquire)) {
+        break;
+      }
+      SegmentedQueue<T>::CpuRelax();
+    }
+    std::unique_lock<std::mutex> locker(mutex_);
+    sleepers_.fetch_add(1, std::memory_order_seq_cst);
+    while (true) {
+      // После увеличения sleepers_ производитель, положивший элемент,
+      // обязательно нас разбудит, поэтому проверка под мьютексом и
+      // засыпание не теряют его.
+      if (queue_.TryPop(result)) {
+        sleepers_.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+      }
+      if (Drained()) {
+        // Вставка, закончившаяся до того, как мы увидели putters_ == 0,
+        // уже в очереди.
+        const bool found = queue_.TryPop(result);
+        sleepers_.fetch_sub(1, std::memory_order_relaxed);
+        return found;
+      }
+      if (interrupted != nullptr && interrupts_ > 0) {
+        --interrupts_;
+        sleepers_.fetch_sub(1, std::memory_order_relaxed);
+        *interrupted = true;
+        return false;
+      }
+      observer_.wait(locker);
+    }
+  }
+
+  void WakeSleepers(bool all) {
+    // Чтение через RMW: либо видим увеличение sleepers_ потребителем,
+    // либо он, увеличив его после нас, увидит положенный элемент.
+    if (sleepers_.fetch_add(0, std::memory_order_seq_cst) == 0) {
+      return;
+    }
+    std::lock_guard<std::mutex> locker(mutex_);
+    if (all) {
+      observer_.notify_all();
+    } else {
+      observer_.notify_one();
+    }
+  }
+
+  SegmentedQueue<T> queue_;
+  alignas(64) std::atomic<size_t> sleepers_{0};
+  std::atomic<bool> closed_{false};
+  // Put и PutBatch, которые прошли проверку closed_ и еще не закончили.
+  alignas(64) std::atomic<size_t> putters_{0};
+  std::mutex mutex_;
+  std::condition_variable observer_;
+  // Непогашенные вызовы Interrupt, под mutex_.
+  size_t interrupts_ = 0;
+};
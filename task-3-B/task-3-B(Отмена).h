@@ -0,0 +1,268 @@
+#pragma once
+// Кооперативная отмена задач.
+// Провилков Иван. группа 593.
+//
+// CancellationSource отменяет, CancellationToken позволяет узнать об
+// отмене: опросом (IsCancelled, ThrowIfCancelled) или подпиской
+// (OnCancel). У токена может быть срок, после которого он считается
+// отмененным; срок проверяется при опросе, подписчиков он не будит.
+//
+// Источник можно создать от токена-родителя: отмена родителя отменяет
+// потомка, а срок потомка не позже срока родителя. Пул потоков
+// выставляет токен выполняемой задачи как CancellationToken::Current(),
+// и задачи, поставленные из нее без явного токена, наследуют его.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+class TaskCancelledException : public std::exception {
+ public:
+  explicit TaskCancelledException(const std::string& log = "Task cancelled")
+      : log_(log) {}
+  const char* what() const noexcept override {
+    return log_.c_str();
+  }
+  std::string log_;
+};
+
+namespace cancellation_detail {
+
+class State;
+
+}  // namespace cancellation_detail
+
+// Подписка на отмену. Снимается в деструкторе; обратный вызов, который
+// уже начал выполняться в отменяющем потоке, при этом не ждем.
+class CancellationRegistration {
+ public:
+  CancellationRegistration() = default;
+  CancellationRegistration(CancellationRegistration&& other) noexcept
+      : state_(std::move(other.state_)), callback_(other.callback_) {}
+  CancellationRegistration& operator=(
+      CancellationRegistration&& other) noexcept {
+    if (this != &other) {
+      Reset();
+      state_ = std::move(other.state_);
+      callback_ = other.callback_;
+    }
+    return *this;
+  }
+
+  ~CancellationRegistration() {
+    Reset();
+  }
+
+  inline void Reset();
+
+ private:
+  friend class cancellation_detail::State;
+  using Callbacks = std::list<std::function<void()> >;
+
+  CancellationRegistration(std::weak_ptr<cancellation_detail::State> state,
+                           Callbacks::iterator callback)
+      : state_(std::move(state)), callback_(callback) {}
+
+  std::weak_ptr<cancellation_detail::State> state_;
+  Callbacks::iterator callback_;
+};
+
+namespace cancellation_detail {
+
+using Clock = std::chrono::steady_clock;
+
+class State : public std::enable_shared_from_this<State> {
+ public:
+  explicit State(Clock::time_point deadline) : deadline_(deadline) {}
+
+  bool IsCancelled() const {
+    if (cancelled_.load(std::memory_order_acquire)) {
+      return true;
+    }
+    return deadline_ != Clock::time_point::max() && Clock::now() >= deadline_;
+  }
+
+  Clock::time_point Deadline() const {
+    return deadline_;
+  }
+
+  void Cancel() {
+    CancellationRegistration::Callbacks callbacks;
+    {
+      std::lock_guard<std::mutex> locker(mutex_);
+      if (cancelled_.load(std::memory_order_relaxed)) {
+        return;
+      }
+      cancelled_.store(true, std::memory_order_release);
+      callbacks.swap(callbacks_);
+    }
+    for (std::function<void()>& callback : callbacks) {
+      callback();
+    }
+  }
+
+  // Если уже отменено, вызывает callback сразу.
+  CancellationRegistration Subscribe(std::function<void()> callback) {
+    {
+      std::lock_guard<std::mutex> locker(mutex_);
+      if (!cancelled_.load(std::memory_order_relaxed)) {
+        callbacks_.push_back(std::move(callback));
+        return CancellationRegistration(weak_from_this(),
+                                        std::prev(callbacks_.end()));
+      }
+    }
+    callback();
+    return CancellationRegistration();
+  }
+
+  void Unsubscribe(CancellationRegistration::Callbacks::iterator callback) {
+    std::lock_guard<std::mutex> locker(mutex_);
+    // После отмены список уже забран отменяющим потоком.
+    if (!cancelled_.load(std::memory_order_relaxed)) {
+      callbacks_.erase(callback);
+    }
+  }
+
+  // Подписка на родителя, живет столько же, сколько состояние.
+  CancellationRegistration parent_registration;
+
+ private:
+  std::atomic<bool> cancelled_{false};
+  const Clock::time_point deadline_;
+  std::mutex mutex_;
+  CancellationRegistration::Callbacks callbacks_;
+};
+
+}  // namespace cancellation_detail
+
+void CancellationRegistration::Reset() {
+  if (std::shared_ptr<cancellation_detail::State> state = state_.lock()) {
+    state->Unsubscribe(callback_);
+  }
+  state_.reset();
+}
+
+class CancellationToken {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  // Токен, который никогда не отменяется.
+  CancellationToken() = default;
+
+  bool IsCancelled() const {
+    return state_ != nullptr && state_->IsCancelled();
+  }
+
+  bool CanBeCancelled() const {
+    return state_ != nullptr;
+  }
+
+  void ThrowIfCancelled() const {
+    if (IsCancelled()) {
+      throw TaskCancelledException();
+    }
+  }
+
+  // Clock::time_point::max(), если срока нет.
+  Clock::time_point Deadline() const {
+    return state_ != nullptr ? state_->Deadline() : Clock::time_point::max();
+  }
+
+  // Вызывает callback при отмене в отменяющем потоке (или сразу, если
+  // токен уже отменен). Истечение срока callback не вызывает.
+  CancellationRegistration OnCancel(std::function<void()> callback) const {
+    if (state_ == nullptr) {
+      return CancellationRegistration();
+    }
+    return state_->Subscribe(std::move(callback));
+  }
+
+  // Токен задачи, которую сейчас выполняет этот поток.
+  static CancellationToken Current() {
+    return CurrentSlot();
+  }
+
+ private:
+  friend class CancellationSource;
+  friend class CancellationScope;
+
+  explicit CancellationToken(
+      std::shared_ptr<cancellation_detail::State> state)
+      : state_(std::move(state)) {}
+
+  static CancellationToken& CurrentSlot() {
+    static thread_local CancellationToken current;
+    return current;
+  }
+
+  std::shared_ptr<cancellation_detail::State> state_;
+};
+
+// Делает token текущим для потока до конца области видимости.
+class CancellationScope {
+ public:
+  explicit CancellationScope(CancellationToken token)
+      : previous_(std::move(CancellationToken::CurrentSlot())) {
+    CancellationToken::CurrentSlot() = std::move(token);
+  }
+  CancellationScope(const CancellationScope&) = delete;
+  CancellationScope& operator=(const CancellationScope&) = delete;
+  ~CancellationScope() {
+    CancellationToken::CurrentSlot() = std::move(previous_);
+  }
+
+ private:
+  CancellationToken previous_;
+};
+
+class CancellationSource {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit CancellationSource(Clock::time_point deadline =
+                                  Clock::time_point::max())
+      : state_(std::make_shared<cancellation_detail::State>(deadline)) {}
+
+  // Потомок parent: отменяется вместе с ним и не переживает его срок.
+  explicit CancellationSource(const CancellationToken& parent,
+                              Clock::time_point deadline =
+                                  Clock::time_point::max())
+      : state_(std::make_shared<cancellation_detail::State>(
+            std::min(deadline, parent.Deadline()))) {
+    std::weak_ptr<cancellation_detail::State> child = state_;
+    state_->parent_registration = parent.OnCancel([child] {
+      if (std::shared_ptr<cancellation_detail::State> state = child.lock()) {
+        state->Cancel();
+      }
+    });
+  }
+
+  template <class Rep, class Period>
+  static CancellationSource WithTimeout(
+      std::chrono::duration<Rep, Period> timeout,
+      const CancellationToken& parent = CancellationToken()) {
+    return CancellationSource(parent, Clock::now() + timeout);
+  }
+
+  void Cancel() {
+    state_->Cancel();
+  }
+
+  bool IsCancelled() const {
+    return state_->IsCancelled();
+  }
+
+  CancellationToken Token() const {
+    return CancellationToken(state_);
+  }
+
+ private:
+  std::shared_ptr<cancellation_detail::State> state_;
+};
@@ -0,0 +1,360 @@
+#pragma once
+// Параллельные алгоритмы поверх пула потоков.
+// Провилков Иван. группа 593.
+//
+// ParallelFor, ParallelReduce, ParallelInclusiveScan, ParallelTransform и
+// ParallelSort делят диапазон рекурсивно пополам, пока куски не станут
+// меньше grain, и отдают половины пулу. Поток, который ждет свои
+// подзадачи, сам выполняет задачи из очереди пула (TaskGroup::Wait), так
+// что вложенный параллелизм не блокирует рабочих и не приводит к
+// взаимоблокировке даже в пуле из одного потока.
+//
+// grain == 0 означает автоматический выбор: около восьми кусков на
+// рабочего, чтобы сгладить неравномерность, но не платить за лишние
+// задачи. Тело цикла получает подряд идущие индексы, поэтому внутренний
+// цикл по куску компилятор может векторизовать.
+
+#include "task-3-B(Пул потоков).h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Группа задач с общим ожиданием. Задачи группы могут добавлять в нее
+// новые задачи; Wait дожидается всех. Первое исключение из задач
+// пробрасывается из Wait, оставшиеся задачи группы после него не
+// выполняются.
+class TaskGroup {
+ public:
+  explicit TaskGroup(ThreadPool<void>& pool) : pool_(pool) {}
+
+  TaskGroup(const TaskGroup&) = delete;
+  TaskGroup& operator=(const TaskGroup&) = delete;
+
+  ~TaskGroup() {
+    // Задачи ссылаются на группу, поэтому дожидаемся их даже при
+    // исключении у вызывающего.
+    WaitAll();
+  }
+
+  // Задача видит токен отмены вызывающего; если он отменен, задача не
+  // выполняется, а Wait выбрасывает TaskCancelledException.
+  void Run(std::function<void()> task) {
+    pending_.fetch_add(1, std::memory_order_relaxed);
+    try {
+      // Сама задача группы ставится без токена: пул не должен ее
+      // выбросить, иначе Wait не дождется счетчика.
+      pool_.Submit([this, task = std::move(task),
+                    token = CancellationToken::Current()] {
+        if (!failed_.load(std::memory_order_relaxed)) {
+          try {
+            token.ThrowIfCancelled();
+            CancellationScope scope(token);
+            task();
+          } catch (...) {
+            std::lock_guard<std::mutex> locker(exception_mutex_);
+            if (!failed_.load(std::memory_order_relaxed)) {
+              exception_ = std::current_exception();
+              failed_.store(true, std::memory_order_relaxed);
+            }
+          }
+        }
+        pending_.fetch_sub(1, std::memory_order_release);
+      }, CancellationToken(), "TaskGroup");
+    } catch (...) {
+      pending_.fetch_sub(1, std::memory_order_relaxed);
+      throw;
+    }
+  }
+
+  void Wait() {
+    WaitAll();
+    if (failed_.load(std::memory_order_relaxed)) {
+      std::lock_guard<std::mutex> locker(exception_mutex_);
+      std::exception_ptr exception = std::move(exception_);
+      exception_ = nullptr;
+      failed_.store(false, std::memory_order_relaxed);
+      std::rethrow_exception(exception);
+    }
+  }
+
+  ThreadPool<void>& Pool() {
+    return pool_;
+  }
+
+ private:
+  void WaitAll() {
+    while (pending_.load(std::memory_order_acquire) != 0) {
+      if (!pool_.RunPendingTask()) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+  ThreadPool<void>& pool_;
+  std::atomic<size_t> pending_{0};
+  std::atomic<bool> failed_{false};
+  std::mutex exception_mutex_;
+  std::exception_ptr exception_;
+};
+
+namespace parallel_detail {
+
+inline size_t ChooseGrain(const ThreadPool<void>& pool, size_t size,
+                          size_t grain) {
+  if (grain != 0) {
+    return grain;
+  }
+  const size_t chunks = std::max<size_t>(pool.WorkersCount(), 1) * 8;
+  return std::max<size_t>(size / chunks, 1);
+}
+
+// Делит [begin, end) пополам, отдавая правые половины группе, пока кусок
+// больше grain, и вызывает body(chunk_begin, chunk_end) на левом куске.
+template <class Body>
+void SplitRange(TaskGroup& group, size_t begin, size_t end, size_t grain,
+                const Body& body) {
+  while (end - begin > grain) {
+    const size_t middle = begin + (end - begin) / 2;
+    group.Run([&group, middle, end, grain, &body] {
+      SplitRange(group, middle, end, grain, body);
+    });
+    end = middle;
+  }
+  body(begin, end);
+}
+
+// Сливает отсортированные [first1, last1) и [first2, last2) в out,
+// перемещая элементы. Большие слияния делятся по медиане большей части.
+template <class Iterator, class OutputIterator, class Compare>
+void ParallelMerge(TaskGroup& group, Iterator first1, Iterator last1,
+                   Iterator first2, Iterator last2, OutputIterator out,
+                   const Compare& compare, size_t grain) {
+  while (true) {
+    const size_t size1 = last1 - first1;
+    const size_t size2 = last2 - first2;
+    if (size1 + size2 <= grain) {
+      std::merge(std::make_move_iterator(first1),
+                 std::make_move_iterator(last1),
+                 std::make_move_iterator(first2),
+                 std::make_move_iterator(last2), out, compare);
+      return;
+    }
+    if (size1 < size2) {
+      std::swap(first1, first2);
+      std::swap(last1, last2);
+    }
+    const Iterator middle1 = first1 + (last1 - first1) / 2;
+    const Iterator middle2 = std::lower_bound(first2, last2, *middle1,
+                                              compare);
+    const OutputIterator middle_out =
+        out + (middle1 - first1) + (middle2 - first2);
+    group.Run([&group, middle1, last1, middle2, last2, middle_out,
+               &compare, grain] {
+      ParallelMerge(group, middle1, last1, middle2, last2, middle_out,
+                    compare, grain);
+    });
+    last1 = middle1;
+    last2 = middle2;
+  }
+}
+
+// Сортирует [first, last), используя buffer той же длины. Результат
+// оказывается в buffer, если to_buffer, иначе на месте. Уровни рекурсии
+// чередуют направление, поэтому лишних копирований нет.
+template <class Iterator, class BufferIterator, class Compare>
+void MergeSort(ThreadPool<void>& pool, Iterator first, Iterator last,
+               BufferIterator buffer, bool to_buffer, const Compare& compare,
+               size_t grain) {
+  const size_t size = last - first;
+  if (size <= grain) {
+    std::sort(first, last, compare);
+    if (to_buffer) {
+      std::move(first, last, buffer);
+    }
+    return;
+  }
+  const size_t half = size / 2;
+  {
+    TaskGroup halves(pool);
+    halves.Run([&] {
+      MergeSort(pool, first + half, last, buffer + half, !to_buffer,
+                compare, grain);
+    });
+    MergeSort(pool, first, first + half, buffer, !to_buffer, compare, grain);
+    halves.Wait();
+  }
+  TaskGroup merge(pool);
+  if (to_buffer) {
+    ParallelMerge(merge, first, first + half, first + half, last, buffer,
+                  compare, grain);
+  } else {
+    ParallelMerge(merge, buffer, buffer + half, buffer + half, buffer + size,
+                  first, compare, grain);
+  }
+  merge.Wait();
+}
+
+}  // namespace parallel_detail
+
+// Вызывает body(chunk_begin, chunk_end) на кусках [begin, end) не длиннее
+// grain.
+template <class Body>
+void ParallelForChunks(ThreadPool<void>& pool, size_t begin, size_t end,
+                       size_t grain, const Body& body) {
+  if (begin >= end) {
+    return;
+  }
+  grain = parallel_detail::ChooseGrain(pool, end - begin, grain);
+  TaskGroup group(pool);
+  parallel_detail::SplitRange(group, begin, end, grain, body);
+  group.Wait();
+}
+
+// Вызывает body(i) для каждого i из [begin, end).
+template <class Body>
+void ParallelFor(ThreadPool<void>& pool, size_t begin, size_t end,
+                 size_t grain, const Body& body) {
+  ParallelForChunks(pool, begin, end, grain,
+                    [&body](size_t chunk_begin, size_t chunk_end) {
+    for (size_t i = chunk_begin; i < chunk_end; ++i) {
+      body(i);
+    }
+  });
+}
+
+template <class Body>
+void ParallelFor(ThreadPool<void>& pool, size_t begin, size_t end,
+                 const Body& body) {
+  ParallelFor(pool, begin, end, 0, body);
+}
+
+// *(out + i) = function(*(first + i)) для всех элементов.
+template <class Iterator, class OutputIterator, class Function>
+OutputIterator ParallelTransform(ThreadPool<void>& pool, Iterator first,
+                                 Iterator last, OutputIterator out,
+                                 const Function& function, size_t grain = 0) {
+  const size_t size = last - first;
+  ParallelForChunks(pool, 0, size, grain,
+                    [first, out, &function](size_t begin, size_t end) {
+    std::transform(first + begin, first + end, out + begin, function);
+  });
+  return out + size;
+}
+
+// Свертка init и всех элементов операцией reduce, которая должна быть
+// ассоциативной. Куски сворачиваются параллельно, частичные результаты -
+// по порядку, так что коммутативность не нужна.
+template <class Iterator, class T, class Reduce>
+T ParallelReduce(ThreadPool<void>& pool, Iterator first, Iterator last,
+                 T init, const Reduce& reduce, size_t grain = 0) {
+  const size_t size = last - first;
+  if (size == 0) {
+    return init;
+  }
+  grain = parallel_detail::ChooseGrain(pool, size, grain);
+  const size_t chunks = (size + grain - 1) / grain;
+  std::vector<T> partial(chunks, init);
+  ParallelFor(pool, 0, chunks, 1, [&](size_t chunk) {
+    Iterator it = first + chunk * grain;
+    const Iterator end = first + std::min(size, (chunk + 1) * grain);
+    T value = *it;
+    for (++it; it != end; ++it) {
+      value = reduce(std::move(value), *it);
+    }
+    partial[chunk] = std::move(value);
+  });
+  for (T& value : partial) {
+    init = reduce(std::move(init), std::move(value));
+  }
+  return init;
+}
+
+template <class Iterator, class T>
+T ParallelReduce(ThreadPool<void>& pool, Iterator first, Iterator last,
+                 T init) {
+  return ParallelReduce(pool, first, last, std::move(init), std::plus<T>());
+}
+
+// Включающий префиксный скан: out[i] = first[0] op ... op first[i].
+// Сначала параллельно считаются суммы кусков, затем последовательно их
+// префиксы (кусков немного), затем каждый кусок сканируется от своего
+// префикса. out может совпадать с first.
+template <class Iterator, class OutputIterator, class Operation>
+OutputIterator ParallelInclusiveScan(ThreadPool<void>& pool, Iterator first,
+                                     Iterator last, OutputIterator out,
+                                     const Operation& operation,
+                                     size_t grain = 0) {
+  using Value = typename std::iterator_traits<Iterator>::value_type;
+  const size_t size = last - first;
+  if (size == 0) {
+    return out;
+  }
+  grain = parallel_detail::ChooseGrain(pool, size, grain);
+  const size_t chunks = (size + grain - 1) / grain;
+  auto chunk_end = [size, grain](size_t chunk) {
+    return std::min(size, (chunk + 1) * grain);
+  };
+  std::vector<Value> sums(chunks);
+  ParallelFor(pool, 0, chunks, 1, [&](size_t chunk) {
+    Value sum = first[chunk * grain];
+    for (size_t i = chunk * grain + 1; i < chunk_end(chunk); ++i) {
+      sum = operation(std::move(sum), first[i]);
+    }
+    sums[chunk] = std::move(sum);
+  });
+  for (size_t chunk = 1; chunk < chunks; ++chunk) {
+    sums[chunk] = operation(sums[chunk - 1], sums[chunk]);
+  }
+  ParallelFor(pool, 0, chunks, 1, [&](size_t chunk) {
+    size_t i = chunk * grain;
+    Value sum = chunk == 0 ? Value(first[i])
+                           : operation(sums[chunk - 1], first[i]);
+    out[i] = sum;
+    for (++i; i < chunk_end(chunk); ++i) {
+      sum = operation(std::move(sum), first[i]);
+      out[i] = sum;
+    }
+  });
+  return out + size;
+}
+
+template <class Iterator, class OutputIterator>
+OutputIterator ParallelInclusiveScan(ThreadPool<void>& pool, Iterator first,
+                                     Iterator last, OutputIterator out) {
+  using Value = typename std::iterator_traits<Iterator>::value_type;
+  return ParallelInclusiveScan(pool, first, last, out, std::plus<Value>());
+}
+
+// Параллельная сортировка слиянием; куски не длиннее grain сортируются
+// std::sort, слияния тоже параллельные. Нужен буфер размером с диапазон,
+// поэтому элементы должны конструироваться по умолчанию. Сортировка
+// неустойчивая.
+template <class Iterator, class Compare>
+void ParallelSort(ThreadPool<void>& pool, Iterator first, Iterator last,
+                  const Compare& compare, size_t grain = 0) {
+  using Value = typename std::iterator_traits<Iterator>::value_type;
+  const size_t size = last - first;
+  if (size < 2) {
+    return;
+  }
+  // Сортировка кусков дороже линейных проходов, поэтому порог не меньше
+  // нескольких тысяч элементов.
+  grain = std::max<size_t>(parallel_detail::ChooseGrain(pool, size, grain),
+                           grain == 0 ? 4096 : 1);
+  std::vector<Value> buffer(size);
+  parallel_detail::MergeSort(pool, first, last, buffer.begin(), false,
+                             compare, grain);
+}
+
+template <class Iterator>
+void ParallelSort(ThreadPool<void>& pool, Iterator first, Iterator last) {
+  using Value = typename std::iterator_traits<Iterator>::value_type;
+  ParallelSort(pool, first, last, std::less<Value>());
+}
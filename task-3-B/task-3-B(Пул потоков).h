@@ -2,15 +2,30 @@
 // Пул потоков.
 // Провилков Иван. группа 593.
 
+#include "../lock_profiler.h"
+#include "../task-3-A/task-3-A(Сегментная очередь).h"
+#include "task-3-B(Отмена).h"
+#include "task-3-B(Таймеры).h"
+#include "task-3-B(Топология).h"
+#include "task-3-B(Трассировка).h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <deque>
 #include <exception>
 #include <functional>
 #include <future>
 #include <iostream>
+#include <limits>
+#include <memory>
 #include <mutex>
+#include <ostream>
 #include <string>
 #include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 // Многопоточная блокирующая очередь.
@@ -26,9 +41,11 @@ class BlockingQueue {
   // Блокирующая очередь фиксированной вместимости.
  public:
   explicit BlockingQueue(const size_t& capacity)
-      : capacity_(capacity), queue_is_working_(true) {}
+      : capacity_(capacity), queue_is_working_(true) {
+    lock_profiler::SetName(mutex_, "BlockingQueue");
+  }
   void Put(T&& element) {
-    std::unique_lock<std::mutex> locker(mutex_);
+    std::unique_lock<Mutex> locker(mutex_);
     put_observer_.wait(locker, [this]() {return !queue_is_working_ ||
         queue_.size() < capacity_;});
     if (!queue_is_working_) {
@@ -37,8 +54,29 @@ class BlockingQueue {
     queue_.push_back(std::move(element));
     get_observer_.notify_one();
   }
+  // Кладет все элементы за один захват мьютекса, если хватает места,
+  // и будит столько потребителей, сколько элементов положено.
+  void PutBatch(std::vector<T>& elements) {
+    std::unique_lock<Mutex> locker(mutex_);
+    for (T& element : elements) {
+      if (queue_is_working_ && queue_.size() >= capacity_) {
+        get_observer_.notify_all();
+        put_observer_.wait(locker, [this]() {return !queue_is_working_ ||
+            queue_.size() < capacity_;});
+      }
+      if (!queue_is_working_) {
+        throw BlockingQueueException("Try put to disabled queue");
+      }
+      queue_.push_back(std::move(element));
+    }
+    if (elements.size() == 1) {
+      get_observer_.notify_one();
+    } else if (elements.size() > 1) {
+      get_observer_.notify_all();
+    }
+  }
   bool Get(T& result) {
-    std::unique_lock<std::mutex> lock(mutex_);
+    std::unique_lock<Mutex> lock(mutex_);
     get_observer_.wait(lock, [this]() {return queue_.size() != 0 ||
         !queue_is_working_;});
     if (!queue_is_working_ && queue_.size() == 0) {
@@ -49,24 +87,65 @@ class BlockingQueue {
     put_observer_.notify_one();
     return true;
   }
+  // Неблокирующий Put: возвращает false, если очередь заполнена, и тогда
+  // element не трогается.
+  bool TryPut(T&& element) {
+    std::unique_lock<Mutex> lock(mutex_);
+    if (!queue_is_working_) {
+      throw BlockingQueueException("Try put to disabled queue");
+    }
+    if (queue_.size() >= capacity_) {
+      return false;
+    }
+    queue_.push_back(std::move(element));
+    get_observer_.notify_one();
+    return true;
+  }
+  // Неблокирующий Get: возвращает false, если очередь пуста.
+  bool TryGet(T& result) {
+    std::unique_lock<Mutex> lock(mutex_);
+    if (queue_.size() == 0) {
+      return false;
+    }
+    result = std::move(queue_.front());
+    queue_.pop_front();
+    put_observer_.notify_one();
+    return true;
+  }
   void Shutdown() {
     // Захватываем мьютекс, так как иначе может оказаться, что мы сделали
     // Shutdown, после того как поток проверил что очередь еще работает, но до
     // того как он встал в wait в функции get, и тогда он так и будет спать.
-    std::unique_lock<std::mutex> lock(mutex_);
+    std::unique_lock<Mutex> lock(mutex_);
     queue_is_working_ = false;
     put_observer_.notify_all();
     get_observer_.notify_all();
   }
  private:
-  std::mutex mutex_;
+  using Mutex = lock_profiler::Profiled<std::mutex>;
+
+  Mutex mutex_;
   size_t capacity_;
   Container queue_;
-  std::condition_variable put_observer_, get_observer_;
+  lock_profiler::ConditionVariableFor<Mutex> put_observer_, get_observer_;
   bool queue_is_working_;
 };
 
 // Пул потоков.
+//
+// Задачи лежат в неограниченной lock-free очереди BlockingSegmentedQueue:
+// постановка и взятие задачи не берут мьютексов, рабочие засыпают на
+// условной переменной, только когда задач нет.
+//
+// Пул ведет живые счетчики (Stats) и по EnableTracing пишет трассу
+// задач, которую WriteChromeTrace выгружает в формате Chrome trace.
+//
+// С ThreadPoolOptions рабочих можно привязать к процессорам или узлам
+// NUMA и завести по очереди на узел: задача ставится в очередь узла
+// (явно через SubmitToNode, иначе в очередь узла ставящего рабочего),
+// а на другой узел уходит, только если там есть простаивающие рабочие.
+// Рабочий с пустой очередью сначала забирает задачи с других узлов и
+// только потом засыпает.
 template <class T>
 class ThreadPool {
  public:
@@ -75,32 +154,255 @@ class ThreadPool {
 
   explicit ThreadPool(const size_t& num_threads = DefaultNumWorkers())
       : workers_number_(num_threads), pool_is_working_(true),
-        task_queue_(std::numeric_limits<size_t>::max()) {
-    for (uint64_t i = 0; i < workers_number_; ++i) {
-      // Раздаем задачи потокам.
-      threads_.emplace_back(&ThreadPool::EnableWorker, this);
+        counters_(num_threads) {
+    nodes_.push_back(std::make_unique<NodeQueue>(0));
+    StartWorkers(std::vector<size_t>(num_threads, 0),
+                 std::vector<std::vector<int> >(num_threads));
+  }
+
+  explicit ThreadPool(const ThreadPoolOptions& options)
+      : workers_number_(options.workers != 0
+                            ? options.workers
+                            : std::max<size_t>(options.topology.CpuCount(),
+                                               1)),
+        pool_is_working_(true),
+        counters_(workers_number_) {
+    const std::vector<CpuNode>& topology = options.topology.Nodes();
+    // Узлы с процессорами. Рабочие раздаются по ним по кругу, а внутри
+    // узла - по его процессорам, так что рабочих меньше, чем
+    // процессоров, не собираются все на первом узле. Очередь заводится
+    // только узлам, которым достался рабочий: из очереди узла без
+    // рабочих задачи забирались бы только кражей.
+    std::vector<size_t> used_nodes;
+    for (size_t node = 0; node < topology.size(); ++node) {
+      if (!topology[node].cpus.empty()) {
+        used_nodes.push_back(node);
+      }
+    }
+    if (used_nodes.size() > workers_number_) {
+      used_nodes.resize(workers_number_);
+    }
+    if (options.node_queues) {
+      for (size_t node : used_nodes) {
+        nodes_.push_back(std::make_unique<NodeQueue>(topology[node].id));
+      }
+    }
+    if (nodes_.empty()) {
+      nodes_.push_back(std::make_unique<NodeQueue>(
+          used_nodes.empty() ? 0 : topology[used_nodes[0]].id));
     }
+    std::vector<size_t> worker_nodes(workers_number_, 0);
+    std::vector<std::vector<int> > worker_cpus(workers_number_);
+    for (size_t i = 0; i < workers_number_ && !used_nodes.empty(); ++i) {
+      const size_t slot = i % used_nodes.size();
+      const std::vector<int>& cpus = topology[used_nodes[slot]].cpus;
+      if (options.node_queues) {
+        worker_nodes[i] = slot;
+      }
+      if (options.pinning == WorkerPinning::kCore) {
+        worker_cpus[i] = {cpus[i / used_nodes.size() % cpus.size()]};
+      } else if (options.pinning == WorkerPinning::kNode) {
+        worker_cpus[i] = cpus;
+      }
+    }
+    StartWorkers(worker_nodes, worker_cpus);
   }
 
   // Добавляет задачу в конец очереди пула, через future можно получить
-  // результат задачи.
-  std::future<T> Submit(std::function<T()> task) {
-    std::packaged_task<T()> current_task(task);
-    std::future<T> future = current_task.get_future();
-    // Здесь выкинется исключение, если ранее был сделан Shutdown.
-    task_queue_.Put(std::move(current_task));
+  // результат задачи. Имя задачи видно в трассе и должно жить дольше
+  // нее, обычно это строковый литерал. Задача получает токен отмены
+  // той задачи, из которой ее поставили (CancellationToken::Current()).
+  std::future<T> Submit(std::function<T()> task, const char* name = "task") {
+    return Submit(std::move(task), CancellationToken::Current(), name);
+  }
+
+  // Если token отменят или истечет его срок до того, как задача начнет
+  // выполняться, она не выполнится, а future получит
+  // TaskCancelledException: при отмене сразу, при истечении срока -
+  // когда задача дойдет до начала очереди. Внутри задачи token доступен
+  // как CancellationToken::Current() для кооперативных проверок.
+  std::future<T> Submit(std::function<T()> task, CancellationToken token,
+                        const char* name = "task") {
+    return SubmitToNode(kAnyNode, std::move(task), std::move(token), name);
+  }
+
+  // Ставит задачу в очередь узла node (номер из 0..NodesCount()-1).
+  std::future<T> SubmitToNode(size_t node, std::function<T()> task,
+                              CancellationToken token =
+                                  CancellationToken::Current(),
+                              const char* name = "task") {
+    Task current_task = MakeTask(std::move(task), std::move(token), name);
+    std::future<T> future = current_task.state->promise.get_future();
+    if (current_task.state->token.CanBeCancelled()) {
+      std::weak_ptr<TaskState> weak_state = current_task.state;
+      current_task.state->registration =
+          current_task.state->token.OnCancel([weak_state] {
+            if (std::shared_ptr<TaskState> state = weak_state.lock()) {
+              state->Abandon();
+            }
+          });
+    }
+    const uint64_t sequence =
+        submitted_.fetch_add(1, std::memory_order_relaxed);
+    const size_t chosen = ChooseNode(node, sequence);
+    // Если ранее был сделан Shutdown, выкидываем исключение.
+    if (!nodes_[chosen]->queue.Put(std::move(current_task))) {
+      submitted_.fetch_sub(1, std::memory_order_relaxed);
+      throw BlockingQueueException("Try put to disabled queue");
+    }
+    WakeThief(chosen);
     return future;
   }
 
+  // Отложенные и периодические задачи. Их обслуживает одно колесо
+  // таймеров с отдельным потоком, которое создается при первом вызове;
+  // истекшие задачи попадают в очередь пула пачкой. Результат задачи
+  // отбрасывается. Ручка позволяет отменить таймер.
+  TimerHandle ScheduleAt(std::chrono::steady_clock::time_point when,
+                         std::function<T()> task) {
+    return ScheduleTimer(when, std::move(task),
+                         std::chrono::steady_clock::duration::zero());
+  }
+
+  template <class Rep, class Period>
+  TimerHandle ScheduleAfter(std::chrono::duration<Rep, Period> delay,
+                            std::function<T()> task) {
+    return ScheduleAt(std::chrono::steady_clock::now() + delay,
+                      std::move(task));
+  }
+
+  // Первый запуск через period, дальше каждые period без накопления
+  // сдвига. Если пул не успевает, пропущенные запуски не догоняются.
+  template <class Rep, class Period>
+  TimerHandle ScheduleEvery(std::chrono::duration<Rep, Period> period,
+                            std::function<T()> task) {
+    const auto step =
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            period);
+    return ScheduleTimer(std::chrono::steady_clock::now() + step,
+                         std::move(task), step);
+  }
+
+  // Включает запись трассы: до events_per_worker событий на поток между
+  // выгрузками. Буферы выделяются при первом включении и потом не
+  // меняются.
+  void EnableTracing(size_t events_per_worker = 1 << 16) {
+    std::call_once(rings_allocated_, [this, events_per_worker] {
+      rings_.reserve(counters_.size());
+      for (size_t i = 0; i < counters_.size(); ++i) {
+        rings_.push_back(std::make_unique<TraceRing>(events_per_worker));
+      }
+      rings_allocated_flag_.store(true, std::memory_order_release);
+    });
+    tracing_.store(true, std::memory_order_release);
+  }
+
+  void DisableTracing() {
+    tracing_.store(false, std::memory_order_relaxed);
+  }
+
+  // Выгружает накопленные события и очищает буферы. Вызывать из одного
+  // потока за раз.
+  void WriteChromeTrace(std::ostream& out) {
+    ChromeTraceWriter writer(out);
+    uint64_t dropped = 0;
+    for (size_t i = 0; i < counters_.size(); ++i) {
+      writer.ThreadName(i, "worker");
+    }
+    if (rings_allocated_flag_.load(std::memory_order_acquire)) {
+      for (size_t i = 0; i < rings_.size(); ++i) {
+        rings_[i]->Drain([&writer, i](const TaskTraceEvent& event) {
+          writer.Task(i, event);
+        });
+        dropped += rings_[i]->Dropped();
+      }
+    }
+    writer.Finish(dropped);
+  }
+
+  size_t WorkersCount() const {
+    return counters_.size();
+  }
+
+  // Число очередей узлов; 1, если пул создан без node_queues.
+  size_t NodesCount() const {
+    return nodes_.size();
+  }
+
+  // Номер узла в sysfs, например для AllocateOnNode.
+  int NodeId(size_t node) const {
+    return nodes_[node]->id;
+  }
+
+  // Узел рабочего этого пула, который вызывает функцию, или kAnyNode.
+  size_t CurrentNode() const {
+    const WorkerIdentity& identity = CurrentWorker();
+    return identity.pool == this ? identity.node : kAnyNode;
+  }
+
+  static constexpr size_t kAnyNode = static_cast<size_t>(-1);
+
+  // Выполняет в текущем потоке одну задачу из очереди, если она есть.
+  // Так поток, который ждет свои подзадачи, помогает пулу вместо того,
+  // чтобы занимать рабочего впустую. Такие задачи попадают в счетчики,
+  // но не в трассу.
+  bool RunPendingTask() {
+    Task task;
+    const size_t node = CurrentNode();
+    if (!(node != kAnyNode && nodes_[node]->queue.TryGet(task)) &&
+        !Steal(node, task)) {
+      return false;
+    }
+    Execute<true>(task, helper_counters_, nullptr);
+    return true;
+  }
+
+  ThreadPoolStats Stats() const {
+    ThreadPoolStats stats;
+    stats.timestamp_ns = TraceClockNs();
+    stats.workers = counters_.size();
+    uint64_t started = 0;
+    auto add = [&](const WorkerCounters& counters) {
+      started += counters.started.load(std::memory_order_relaxed);
+      stats.completed += counters.completed.load(std::memory_order_relaxed);
+      stats.busy_ns += counters.busy_ns.load(std::memory_order_relaxed);
+    };
+    for (const WorkerCounters& counters : counters_) {
+      add(counters);
+    }
+    add(helper_counters_);
+    // Рабочий увеличивает started после того, как взял задачу, поэтому
+    // читаем submitted последним, чтобы разность не ушла в минус.
+    stats.submitted = submitted_.load(std::memory_order_relaxed);
+    stats.queue_depth =
+        stats.submitted > started ? stats.submitted - started : 0;
+    stats.cancelled = cancelled_.load(std::memory_order_relaxed);
+    stats.spilled = spilled_.load(std::memory_order_relaxed);
+    stats.stolen = stolen_.load(std::memory_order_relaxed);
+    if (rings_allocated_flag_.load(std::memory_order_acquire)) {
+      for (const std::unique_ptr<TraceRing>& ring : rings_) {
+        stats.dropped_events += ring->Dropped();
+      }
+    }
+    return stats;
+  }
+
   void Shutdown() {
-    if (pool_is_working_) {
-      pool_is_working_ = false;
-      std::unique_lock<std::mutex> locker(mutex_);
-      task_queue_.Shutdown();
+    if (pool_is_working_.exchange(false)) {
+      std::call_once(timers_created_, [] {});
+      if (timers_ != nullptr) {
+        timers_->Stop();
+      }
+      for (const std::unique_ptr<NodeQueue>& node : nodes_) {
+        node->queue.Shutdown();
+      }
+      std::unique_lock<Mutex> locker(mutex_);
       workers_observer_.wait(locker, [this] { return workers_number_ == 0; });
+      locker.unlock();
       for (uint64_t i = 0; i < threads_.size(); ++i) {
         threads_[i].join();
       }
+      FailPendingTasks();
     }
   }
 
@@ -109,17 +411,285 @@ class ThreadPool {
   }
 
  private:
+  // Общее состояние задачи и ее future. Выполнить задачу или отменить
+  // ее может только тот, кто первым выставит claimed.
+  struct TaskState {
+    std::function<T()> function;
+    std::promise<T> promise;
+    CancellationToken token;
+    CancellationRegistration registration;
+    std::atomic<bool> claimed{false};
+
+    bool Claim() {
+      return !claimed.load(std::memory_order_relaxed) &&
+          !claimed.exchange(true, std::memory_order_acq_rel);
+    }
+
+    // Завершает future исключением отмены, если задача еще не начата.
+    bool Abandon() {
+      if (!Claim()) {
+        return false;
+      }
+      promise.set_exception(
+          std::make_exception_ptr(TaskCancelledException()));
+      return true;
+    }
+
+    void Run() {
+      CancellationScope scope(token);
+      try {
+        if constexpr (std::is_void<T>::value) {
+          function();
+          promise.set_value();
+        } else {
+          promise.set_value(function());
+        }
+      } catch (...) {
+        promise.set_exception(std::current_exception());
+      }
+    }
+  };
+
+  struct Task {
+    std::shared_ptr<TaskState> state;
+    const char* name = nullptr;
+    // Заполняется, только если при постановке была включена трассировка.
+    uint64_t submit_ns = 0;
+  };
+
+  Task MakeTask(std::function<T()> function, CancellationToken token,
+                const char* name) {
+    Task task;
+    task.state = std::make_shared<TaskState>();
+    task.state->function = std::move(function);
+    task.state->token = std::move(token);
+    task.name = name;
+    if (tracing_.load(std::memory_order_acquire)) {
+      task.submit_ns = TraceClockNs();
+    }
+    return task;
+  }
+
+  struct alignas(64) NodeQueue {
+    explicit NodeQueue(int id) : id(id) {}
+
+    const int id;
+    BlockingSegmentedQueue<Task> queue;
+    // Рабочие узла, которые спят в ожидании задачи.
+    alignas(64) std::atomic<size_t> idle{0};
+  };
+
+  struct WorkerIdentity {
+    const ThreadPool* pool = nullptr;
+    size_t node = 0;
+  };
+
+  static WorkerIdentity& CurrentWorker() {
+    static thread_local WorkerIdentity identity;
+    return identity;
+  }
+
+  void StartWorkers(const std::vector<size_t>& worker_nodes,
+                    const std::vector<std::vector<int> >& worker_cpus) {
+    lock_profiler::SetName(mutex_, "ThreadPool");
+    for (uint64_t i = 0; i < worker_nodes.size(); ++i) {
+      // Раздаем задачи потокам.
+      threads_.emplace_back(&ThreadPool::EnableWorker, this, i,
+                            worker_nodes[i], worker_cpus[i]);
+    }
+  }
+
+  // Узел для новой задачи: запрошенный, иначе узел ставящего рабочего,
+  // иначе по кругу. Если на выбранном узле никто не ждет задач, а на
+  // другом ждут, задача уходит туда.
+  size_t ChooseNode(size_t hint, uint64_t sequence) {
+    if (nodes_.size() == 1) {
+      return 0;
+    }
+    size_t node = hint < nodes_.size() ? hint : CurrentNode();
+    if (node == kAnyNode) {
+      node = sequence % nodes_.size();
+    }
+    if (nodes_[node]->idle.load(std::memory_order_relaxed) != 0) {
+      return node;
+    }
+    for (size_t i = 1; i < nodes_.size(); ++i) {
+      const size_t other = (node + i) % nodes_.size();
+      if (nodes_[other]->idle.load(std::memory_order_relaxed) != 0) {
+        spilled_.fetch_add(1, std::memory_order_relaxed);
+        return other;
+      }
+    }
+    return node;
+  }
+
+  // Задача легла на узел node, где никто не ждет работы. Если на другом
+  // узле спят рабочие, будим одного: он украдет задачу, а не будет спать,
+  // пока рабочие node заняты.
+  void WakeThief(size_t node) {
+    if (nodes_.size() == 1 ||
+        nodes_[node]->idle.load(std::memory_order_relaxed) != 0) {
+      return;
+    }
+    for (size_t i = 1; i < nodes_.size(); ++i) {
+      NodeQueue& other = *nodes_[(node + i) % nodes_.size()];
+      if (other.idle.load(std::memory_order_relaxed) != 0 &&
+          other.queue.Interrupt()) {
+        return;
+      }
+    }
+  }
+
+  // Забирает задачу из очереди любого узла, кроме home.
+  bool Steal(size_t home, Task& task) {
+    for (size_t i = 1; i <= nodes_.size(); ++i) {
+      const size_t node = home == kAnyNode ? i - 1
+                                           : (home + i) % nodes_.size();
+      if (node != home && nodes_[node]->queue.TryGet(task)) {
+        if (home != kAnyNode) {
+          stolen_.fetch_add(1, std::memory_order_relaxed);
+        }
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Рабочие доделывают все, что успели поставить до Shutdown, так что
+  // здесь очереди обычно пусты. Если что-то осталось, future получает
+  // исключение сейчас, а не когда разрушится пул.
+  void FailPendingTasks() {
+    for (const std::unique_ptr<NodeQueue>& node : nodes_) {
+      Task task;
+      while (node->queue.TryGet(task)) {
+        if (task.state->Claim()) {
+          task.state->promise.set_exception(std::make_exception_ptr(
+              BlockingQueueException("Pool was shut down before the task "
+                                     "started")));
+        }
+        cancelled_.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+  }
+
   static int64_t DefaultNumWorkers(){
     int default_size = std::thread::hardware_concurrency();
     return  bool(default_size) ? default_size : 4;
   }
 
-  void EnableWorker() {
+  // Shutdown может остановить колесо между Timers() и постановкой
+  // таймера; тогда, как и при закрытом пуле, бросаем
+  // BlockingQueueException, а не теряем задачу молча.
+  TimerHandle ScheduleTimer(std::chrono::steady_clock::time_point when,
+                            std::function<T()> task,
+                            std::chrono::steady_clock::duration period) {
+    try {
+      return Timers().ScheduleAt(when, std::move(task), period);
+    } catch (const TimerWheelException&) {
+      throw BlockingQueueException("Try schedule to disabled pool");
+    }
+  }
+
+  TimerWheel<std::function<T()> >& Timers() {
+    if (!pool_is_working_) {
+      throw BlockingQueueException("Try schedule to disabled pool");
+    }
+    std::call_once(timers_created_, [this] {
+      timers_ = std::make_shared<TimerWheel<std::function<T()> > >(
+          [this](std::vector<std::function<T()> >& batch) {
+            DispatchTimers(batch);
+          });
+    });
+    // Shutdown мог успеть между проверкой выше и call_once и занять
+    // timers_created_ пустой функцией, тогда колеса нет и не будет.
+    if (timers_ == nullptr) {
+      throw BlockingQueueException("Try schedule to disabled pool");
+    }
+    return *timers_;
+  }
+
+  void DispatchTimers(std::vector<std::function<T()> >& batch) {
+    std::vector<Task> tasks;
+    tasks.reserve(batch.size());
+    for (std::function<T()>& function : batch) {
+      tasks.push_back(MakeTask(std::move(function), CancellationToken(),
+                               "timer"));
+    }
+    const uint64_t sequence =
+        submitted_.fetch_add(tasks.size(), std::memory_order_relaxed);
+    const size_t chosen = ChooseNode(kAnyNode, sequence);
+    if (!nodes_[chosen]->queue.PutBatch(tasks)) {
+      // Пул уже остановлен, задачи никто не выполнит.
+      submitted_.fetch_sub(tasks.size(), std::memory_order_relaxed);
+      return;
+    }
+    WakeThief(chosen);
+  }
+
+  // kShared - пишут ли в counters несколько потоков; ring - буфер
+  // трассы потока, если он у него свой.
+  template <bool kShared>
+  void Execute(Task& task, WorkerCounters& counters, TraceRing* ring) {
+    auto increase = kShared ? &WorkerCounters::IncreaseShared
+                            : &WorkerCounters::Increase;
+    increase(counters.started, 1);
+    // Отмененную задачу выбрасываем, не запуская; future уже завершен
+    // тем, кто отменил, или завершаем здесь, если истек срок.
+    if (!task.state->Claim()) {
+      cancelled_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    if (task.state->token.IsCancelled()) {
+      task.state->promise.set_exception(
+          std::make_exception_ptr(TaskCancelledException()));
+      cancelled_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    task.state->registration.Reset();
+    const uint64_t start_ns = TraceClockNs();
+    task.state->Run();
+    const uint64_t finish_ns = TraceClockNs();
+    increase(counters.busy_ns, finish_ns - start_ns);
+    increase(counters.completed, 1);
+    if (ring != nullptr && task.submit_ns != 0 &&
+        tracing_.load(std::memory_order_acquire)) {
+      ring->TryPush({task.name, task.submit_ns, start_ns, finish_ns});
+    }
+  }
+
+  void EnableWorker(size_t index, size_t node, std::vector<int> cpus) {
+    if (!cpus.empty()) {
+      PinCurrentThread(cpus);
+    }
+    CurrentWorker() = WorkerIdentity{this, node};
+    WorkerCounters& counters = counters_[index];
+    NodeQueue& home = *nodes_[node];
     while (true) {
-      std::packaged_task<T()> task;
-      if (task_queue_.Get(task)) {
-        task();
+      Task task;
+      bool found = home.queue.TryGet(task) || Steal(node, task);
+      if (!found) {
+        bool interrupted = false;
+        home.idle.fetch_add(1, std::memory_order_relaxed);
+        found = home.queue.Get(task, interrupted);
+        home.idle.fetch_sub(1, std::memory_order_relaxed);
+        // Нас разбудили ради задачи на другом узле, или очередь узла
+        // закрыта и пуста, но на других еще могут быть задачи,
+        // поставленные до Shutdown.
+        found = found || Steal(node, task);
+        if (!found && interrupted) {
+          // Задачу забрали раньше нас.
+          continue;
+        }
+      }
+      if (found) {
+        // Буферы трассы выделяются до того, как у задачи появится
+        // submit_ns, так что здесь они уже видны.
+        Execute<false>(task, counters,
+                       task.submit_ns != 0 ? rings_[index].get() : nullptr);
       } else {
+        // Уменьшаем счетчик под мьютексом, иначе Shutdown может проверить
+        // условие до уменьшения, а уснуть после оповещения.
+        std::lock_guard<Mutex> locker(mutex_);
         --workers_number_;
         if (workers_number_ == 0)
           workers_observer_.notify_one();
@@ -130,8 +700,30 @@ class ThreadPool {
 
   std::vector<std::thread> threads_;
   std::atomic<size_t> workers_number_;
+  using Mutex = lock_profiler::Profiled<std::mutex>;
+
   std::atomic<bool> pool_is_working_;
-  std::mutex mutex_;
-  BlockingQueue<std::packaged_task<T()> > task_queue_;
-  std::condition_variable workers_observer_;
+  Mutex mutex_;
+  // Очереди узлов; без node_queues одна общая.
+  std::vector<std::unique_ptr<NodeQueue> > nodes_;
+  lock_profiler::ConditionVariableFor<Mutex> workers_observer_;
+
+  // Телеметрия.
+  alignas(64) std::atomic<uint64_t> submitted_{0};
+  std::atomic<uint64_t> cancelled_{0};
+  std::atomic<uint64_t> spilled_{0};
+  std::atomic<uint64_t> stolen_{0};
+  std::vector<WorkerCounters> counters_;
+  // Задачи, выполненные через RunPendingTask.
+  WorkerCounters helper_counters_;
+  std::atomic<bool> tracing_{false};
+  std::once_flag rings_allocated_;
+  // Буферы после выделения не меняются, флаг публикует их читателям.
+  std::atomic<bool> rings_allocated_flag_{false};
+  std::vector<std::unique_ptr<TraceRing> > rings_;
+
+  // Колесо таймеров, создается лениво. Объявлено последним, чтобы его
+  // поток остановился раньше, чем разрушится остальной пул.
+  std::once_flag timers_created_;
+  std::shared_ptr<TimerWheel<std::function<T()> > > timers_;
 };
@@ -0,0 +1,383 @@
+#pragma once
+// Иерархическое колесо таймеров.
+// Провилков Иван. группа 593.
+//
+// Тик - 1 мс, четыре уровня по 256 ячеек: уровень L покрывает задержки
+// до 256^(L+1) тиков (верхний - около 49 дней, более далекие таймеры
+// кладутся на верхний уровень и перекладываются, пока не приблизятся).
+// Ячейка - интрузивный двусвязный список узлов, узлы лежат в общем
+// массиве и связаны индексами, так что вставка и отмена - O(1), а
+// миллион ждущих таймеров стоит только памяти под узлы.
+//
+// Колесо обслуживает один поток. Он спит до ближайшей непустой ячейки
+// нижнего уровня (или до ближайшего переноса верхних уровней), а
+// истекшие за тик таймеры отдает одной пачкой в dispatch, не держа
+// мьютекса колеса.
+
+#include "../lock_profiler.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class TimerWheelException : public std::exception {
+ public:
+  explicit TimerWheelException(const std::string& log) : log_(log) {}
+  std::string log_;
+};
+
+// То, что умеет отменять таймер по его номеру и поколению.
+class TimerCancelTarget {
+ public:
+  virtual ~TimerCancelTarget() = default;
+  virtual bool Cancel(uint32_t index, uint32_t generation) = 0;
+};
+
+// Ручка таймера. Можно копировать и переживать колесо: после
+// уничтожения колеса Cancel просто возвращает false.
+class TimerHandle {
+ public:
+  TimerHandle() = default;
+  TimerHandle(std::weak_ptr<TimerCancelTarget> target, uint32_t index,
+              uint32_t generation)
+      : target_(std::move(target)), index_(index), generation_(generation) {}
+
+  // Возвращает true, если таймер был отменен до срабатывания (для
+  // периодического - если он еще был активен). Уже отданный в пул
+  // вызов не отменяется.
+  bool Cancel() {
+    std::shared_ptr<TimerCancelTarget> target = target_.lock();
+    return target != nullptr && target->Cancel(index_, generation_);
+  }
+
+ private:
+  std::weak_ptr<TimerCancelTarget> target_;
+  uint32_t index_ = 0;
+  uint32_t generation_ = 0;
+};
+
+template <class Callback>
+class TimerWheel : public TimerCancelTarget,
+                   public std::enable_shared_from_this<TimerWheel<Callback> > {
+ public:
+  using Clock = std::chrono::steady_clock;
+  using Tick = std::chrono::milliseconds;
+  // Получает истекшие за тик вызовы; может забирать их из вектора.
+  using Dispatch = std::function<void(std::vector<Callback>&)>;
+
+  explicit TimerWheel(Dispatch dispatch)
+      : dispatch_(std::move(dispatch)), start_(Clock::now()) {
+    lock_profiler::SetName(mutex_, "TimerWheel");
+    heads_.fill(kNil);
+    thread_ = std::thread(&TimerWheel::Run, this);
+  }
+
+  TimerWheel(const TimerWheel&) = delete;
+  TimerWheel& operator=(const TimerWheel&) = delete;
+
+  ~TimerWheel() override {
+    Stop();
+  }
+
+  // Колесо создается через std::make_shared, иначе ручки не смогут его
+  // найти. period == 0 - однократный таймер. После Stop бросает
+  // TimerWheelException: такой таймер никогда бы не сработал.
+  TimerHandle ScheduleAt(Clock::time_point when, Callback callback,
+                         Clock::duration period = Clock::duration::zero()) {
+    std::unique_lock<Mutex> locker(mutex_);
+    if (stopped_) {
+      throw TimerWheelException("Try schedule to stopped timer wheel");
+    }
+    const uint32_t index = AllocateNode();
+    Node& node = nodes_[index];
+    node.callback = std::move(callback);
+    node.period = period > Clock::duration::zero() ? ToTicksCeil(period) : 0;
+    node.expiry = std::max(ToTicksCeil(when - start_), now_);
+    Link(index);
+    ++pending_;
+    const uint32_t generation = node.generation;
+    // Поток колеса спит дольше, чем нужно новому таймеру.
+    if (node.expiry < wake_tick_) {
+      wake_tick_ = node.expiry;
+      wakeup_.notify_one();
+    }
+    locker.unlock();
+    return TimerHandle(this->weak_from_this(), index, generation);
+  }
+
+  bool Cancel(uint32_t index, uint32_t generation) override {
+    std::lock_guard<Mutex> locker(mutex_);
+    if (index >= nodes_.size() || nodes_[index].generation != generation ||
+        !nodes_[index].linked) {
+      return false;
+    }
+    Unlink(index);
+    FreeNode(index);
+    --pending_;
+    return true;
+  }
+
+  size_t Pending() const {
+    std::lock_guard<Mutex> locker(mutex_);
+    return pending_;
+  }
+
+  // Останавливает поток колеса. Ждущие таймеры больше не сработают.
+  void Stop() {
+    {
+      std::lock_guard<Mutex> locker(mutex_);
+      if (stopped_) {
+        return;
+      }
+      stopped_ = true;
+      wakeup_.notify_one();
+    }
+    thread_.join();
+  }
+
+ private:
+  using Mutex = lock_profiler::Profiled<std::mutex>;
+
+  static constexpr size_t kLevels = 4;
+  static constexpr size_t kSlotBits = 8;
+  static constexpr size_t kSlots = size_t(1) << kSlotBits;
+  static constexpr uint64_t kSlotMask = kSlots - 1;
+  static constexpr uint32_t kNil = UINT32_MAX;
+  static constexpr uint64_t kNever = UINT64_MAX;
+
+  struct Node {
+    Callback callback;
+    // Номер тика срабатывания и период в тиках.
+    uint64_t expiry = 0;
+    uint64_t period = 0;
+    uint32_t prev = kNil;
+    uint32_t next = kNil;
+    // Увеличивается при освобождении узла, чтобы старые ручки не
+    // отменили чужой таймер.
+    uint32_t generation = 0;
+    // Номер списка: level * kSlots + slot.
+    uint16_t list = 0;
+    bool linked = false;
+  };
+
+  static uint64_t ToTicksCeil(Clock::duration duration) {
+    if (duration <= Clock::duration::zero()) {
+      return 0;
+    }
+    const Tick ticks = std::chrono::ceil<Tick>(duration);
+    return static_cast<uint64_t>(ticks.count());
+  }
+
+  uint32_t AllocateNode() {
+    if (free_ != kNil) {
+      const uint32_t index = free_;
+      free_ = nodes_[index].next;
+      return index;
+    }
+    nodes_.emplace_back();
+    return static_cast<uint32_t>(nodes_.size() - 1);
+  }
+
+  void FreeNode(uint32_t index) {
+    Node& node = nodes_[index];
+    node.callback = Callback();
+    ++node.generation;
+    node.next = free_;
+    free_ = index;
+  }
+
+  // Кладет узел в ячейку по его expiry относительно now_.
+  void Link(uint32_t index) {
+    Node& node = nodes_[index];
+    const uint64_t delta = node.expiry > now_ ? node.expiry - now_ : 0;
+    size_t level = 0;
+    while (level + 1 < kLevels &&
+           delta >= (uint64_t(1) << (kSlotBits * (level + 1)))) {
+      ++level;
+    }
+    uint64_t position = std::max(node.expiry, now_);
+    const uint64_t horizon = uint64_t(1) << (kSlotBits * kLevels);
+    if (delta >= horizon) {
+      // Дальше горизонта: ставим в последнюю ячейку верхнего уровня,
+      // при переносе узел переложится по настоящему сроку.
+      position = now_ + horizon - 1;
+    }
+    const size_t slot = (position >> (kSlotBits * level)) & kSlotMask;
+    node.list = static_cast<uint16_t>(level * kSlots + slot);
+    node.prev = kNil;
+    node.next = heads_[node.list];
+    if (node.next != kNil) {
+      nodes_[node.next].prev = index;
+    }
+    heads_[node.list] = index;
+    node.linked = true;
+    if (level == 0) {
+      level0_occupied_[slot / 64] |= uint64_t(1) << (slot % 64);
+    } else {
+      ++upper_count_;
+    }
+  }
+
+  void Unlink(uint32_t index) {
+    Node& node = nodes_[index];
+    if (node.prev != kNil) {
+      nodes_[node.prev].next = node.next;
+    } else {
+      heads_[node.list] = node.next;
+    }
+    if (node.next != kNil) {
+      nodes_[node.next].prev = node.prev;
+    }
+    node.linked = false;
+    if (node.list < kSlots) {
+      if (heads_[node.list] == kNil) {
+        level0_occupied_[node.list / 64] &= ~(uint64_t(1) << (node.list % 64));
+      }
+    } else {
+      --upper_count_;
+    }
+  }
+
+  // Снимает список целиком, возвращает его голову.
+  uint32_t TakeList(size_t list) {
+    const uint32_t head = heads_[list];
+    heads_[list] = kNil;
+    if (list < kSlots) {
+      level0_occupied_[list / 64] &= ~(uint64_t(1) << (list % 64));
+    }
+    uint32_t index = head;
+    for (; index != kNil; index = nodes_[index].next) {
+      nodes_[index].linked = false;
+      if (list >= kSlots) {
+        --upper_count_;
+      }
+    }
+    return head;
+  }
+
+  // Обрабатывает тик now_: переносит верхние уровни, если нижний сделал
+  // оборот, и забирает истекшие таймеры в batch.
+  void ProcessTick(std::vector<Callback>& batch) {
+    for (size_t level = 1; level < kLevels; ++level) {
+      if ((now_ & ((uint64_t(1) << (kSlotBits * level)) - 1)) != 0) {
+        break;
+      }
+      const size_t slot = (now_ >> (kSlotBits * level)) & kSlotMask;
+      for (uint32_t index = TakeList(level * kSlots + slot); index != kNil;) {
+        const uint32_t next = nodes_[index].next;
+        Link(index);
+        index = next;
+      }
+    }
+    for (uint32_t index = TakeList(now_ & kSlotMask); index != kNil;) {
+      Node& node = nodes_[index];
+      const uint32_t next = node.next;
+      if (node.period != 0) {
+        batch.push_back(node.callback);
+        // Без дрейфа: следующий срок от предыдущего, а не от now_, но
+        // пропущенные из-за задержки периоды не догоняем.
+        node.expiry = std::max(node.expiry + node.period, now_ + 1);
+        Link(index);
+      } else {
+        batch.push_back(std::move(node.callback));
+        FreeNode(index);
+        --pending_;
+      }
+      index = next;
+    }
+  }
+
+  // Ближайший тик, на котором может что-то произойти.
+  uint64_t NextEventTick() const {
+    uint64_t result = kNever;
+    if (upper_count_ != 0) {
+      result = (now_ | kSlotMask) + 1;
+      if ((now_ & kSlotMask) == 0) {
+        result = now_;
+      }
+    }
+    const size_t current = now_ & kSlotMask;
+    for (size_t distance = 0; distance < kSlots;) {
+      const size_t slot = (current + distance) & kSlotMask;
+      const uint64_t word = level0_occupied_[slot / 64] >> (slot % 64);
+      if (word == 0) {
+        distance += 64 - slot % 64;
+        continue;
+      }
+      distance += __builtin_ctzll(word);
+      if (distance < kSlots) {
+        result = std::min(result, now_ + distance);
+      }
+      break;
+    }
+    return result;
+  }
+
+  uint64_t ElapsedTicks() const {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<Tick>(Clock::now() - start_).count());
+  }
+
+  void Run() {
+    std::vector<Callback> batch;
+    std::unique_lock<Mutex> locker(mutex_);
+    while (!stopped_) {
+      const uint64_t elapsed = ElapsedTicks();
+      while (now_ <= elapsed) {
+        const uint64_t next = NextEventTick();
+        if (next > elapsed) {
+          // До elapsed ничего нет, пустые тики пропускаем разом.
+          now_ = elapsed + 1;
+          break;
+        }
+        now_ = next;
+        ProcessTick(batch);
+        ++now_;
+      }
+      if (!batch.empty()) {
+        locker.unlock();
+        dispatch_(batch);
+        batch.clear();
+        locker.lock();
+        continue;
+      }
+      wake_tick_ = NextEventTick();
+      if (wake_tick_ == kNever) {
+        wakeup_.wait(locker);
+      } else {
+        wakeup_.wait_until(locker, start_ + Tick(wake_tick_));
+      }
+      wake_tick_ = 0;
+    }
+  }
+
+  Dispatch dispatch_;
+  const Clock::time_point start_;
+
+  mutable Mutex mutex_;
+  lock_profiler::ConditionVariableFor<Mutex> wakeup_;
+  std::vector<Node> nodes_;
+  uint32_t free_ = kNil;
+  std::array<uint32_t, kLevels * kSlots> heads_;
+  // Непустые ячейки нижнего уровня, чтобы быстро искать следующую.
+  std::array<uint64_t, kSlots / 64> level0_occupied_{};
+  // Число узлов на верхних уровнях.
+  size_t upper_count_ = 0;
+  size_t pending_ = 0;
+  // Следующий необработанный тик.
+  uint64_t now_ = 0;
+  // До какого тика спит поток колеса; 0 - не спит.
+  uint64_t wake_tick_ = 0;
+  bool stopped_ = false;
+  std::thread thread_;
+};
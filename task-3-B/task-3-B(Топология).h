@@ -0,0 +1,210 @@
+#pragma once
+// Топология процессоров и NUMA-узлов, привязка потоков и выделение
+// памяти на узле.
+// Провилков Иван. группа 593.
+//
+// Топология читается из sysfs (/sys/devices/system/node/node*/cpulist).
+// Если там нет узлов (не Linux, контейнер без sysfs), считается, что
+// узел один и на нем все процессоры из /sys/devices/system/cpu/online
+// или std::thread::hardware_concurrency(). Корень sysfs можно подменить,
+// так что размещение проверяется на любой машине.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <cstdlib>
+#endif
+
+struct CpuNode {
+  int id = 0;
+  std::vector<int> cpus;
+};
+
+class CpuTopology {
+ public:
+  CpuTopology() = default;
+  explicit CpuTopology(std::vector<CpuNode> nodes) : nodes_(std::move(nodes)) {}
+
+  static CpuTopology Detect(const std::string& sysfs = "/sys/devices/system") {
+    std::vector<CpuNode> nodes;
+#ifdef __linux__
+    const std::string node_dir = sysfs + "/node";
+    if (DIR* dir = opendir(node_dir.c_str())) {
+      while (dirent* entry = readdir(dir)) {
+        const std::string name = entry->d_name;
+        if (name.size() <= 4 || name.compare(0, 4, "node") != 0 ||
+            name.find_first_not_of("0123456789", 4) != std::string::npos) {
+          continue;
+        }
+        CpuNode node;
+        node.id = std::stoi(name.substr(4));
+        node.cpus = ParseCpuList(
+            ReadFirstLine(node_dir + "/" + name + "/cpulist"));
+        // Узлы только с памятью (без процессоров) для потоков не нужны.
+        if (!node.cpus.empty()) {
+          nodes.push_back(std::move(node));
+        }
+      }
+      closedir(dir);
+    }
+#endif
+    std::sort(nodes.begin(), nodes.end(),
+              [](const CpuNode& lhs, const CpuNode& rhs) {
+      return lhs.id < rhs.id;
+    });
+    if (nodes.empty()) {
+      CpuNode node;
+      node.cpus = ParseCpuList(ReadFirstLine(sysfs + "/cpu/online"));
+      if (node.cpus.empty()) {
+        const int cpus = std::max(1u, std::thread::hardware_concurrency());
+        for (int cpu = 0; cpu < cpus; ++cpu) {
+          node.cpus.push_back(cpu);
+        }
+      }
+      nodes.push_back(std::move(node));
+    }
+    return CpuTopology(std::move(nodes));
+  }
+
+  // Разбирает список вида "0-3,8,10-11".
+  static std::vector<int> ParseCpuList(const std::string& list) {
+    std::vector<int> cpus;
+    size_t position = 0;
+    while (position < list.size()) {
+      size_t end = list.find(',', position);
+      if (end == std::string::npos) {
+        end = list.size();
+      }
+      const std::string range = list.substr(position, end - position);
+      position = end + 1;
+      const size_t dash = range.find('-');
+      try {
+        const int first = std::stoi(range.substr(0, dash));
+        const int last = dash == std::string::npos
+            ? first : std::stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last; ++cpu) {
+          cpus.push_back(cpu);
+        }
+      } catch (const std::exception&) {
+        // Пустой или испорченный кусок списка пропускаем.
+      }
+    }
+    return cpus;
+  }
+
+  const std::vector<CpuNode>& Nodes() const {
+    return nodes_;
+  }
+
+  size_t CpuCount() const {
+    size_t count = 0;
+    for (const CpuNode& node : nodes_) {
+      count += node.cpus.size();
+    }
+    return count;
+  }
+
+ private:
+  static std::string ReadFirstLine(const std::string& path) {
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line;
+  }
+
+  std::vector<CpuNode> nodes_;
+};
+
+// Привязывает текущий поток к набору процессоров. Возвращает false, если
+// система не поддерживает привязку или отказала.
+inline bool PinCurrentThread(const std::vector<int>& cpus) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus) {
+    if (cpu >= 0 && cpu < CPU_SETSIZE) {
+      CPU_SET(cpu, &set);
+    }
+  }
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+  (void)cpus;
+  return false;
+#endif
+}
+
+// Выделяет bytes байт, физические страницы которых предпочтительно
+// берутся с узла node (MPOL_PREFERRED). Если политику выставить не
+// удалось, память все равно выделяется, а страницы достанутся узлу
+// потока, который первым их тронет. Освобождать через FreeOnNode.
+inline void* AllocateOnNode(size_t bytes, int node) {
+#ifdef __linux__
+  void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) {
+    return nullptr;
+  }
+#ifdef SYS_mbind
+  constexpr int kMpolPreferred = 1;
+  constexpr size_t kMaskBits = 8 * sizeof(unsigned long);
+  if (node >= 0 && static_cast<size_t>(node) < 16 * kMaskBits) {
+    unsigned long mask[16] = {};
+    mask[node / kMaskBits] = 1ul << (node % kMaskBits);
+    syscall(SYS_mbind, memory, bytes, kMpolPreferred, mask,
+            sizeof(mask) * 8, 0);
+  }
+#else
+  (void)node;
+#endif
+  return memory;
+#else
+  (void)node;
+  return std::malloc(bytes);
+#endif
+}
+
+inline void FreeOnNode(void* memory, size_t bytes) {
+  if (memory == nullptr) {
+    return;
+  }
+#ifdef __linux__
+  munmap(memory, bytes);
+#else
+  (void)bytes;
+  std::free(memory);
+#endif
+}
+
+// Как разместить рабочих пула.
+enum class WorkerPinning {
+  // Не привязывать, потоки плавают по всем процессорам.
+  kNone,
+  // Каждый рабочий на своем процессоре.
+  kCore,
+  // Рабочий может работать на любом процессоре своего узла.
+  kNode,
+};
+
+struct ThreadPoolOptions {
+  // 0 - по одному рабочему на процессор из топологии.
+  size_t workers = 0;
+  WorkerPinning pinning = WorkerPinning::kNone;
+  // Своя очередь на каждый узел: задача выполняется на узле, куда ее
+  // поставили, и уходит на другой, только если там простаивают рабочие.
+  bool node_queues = false;
+  CpuTopology topology = CpuTopology::Detect();
+};
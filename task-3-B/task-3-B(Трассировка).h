@@ -0,0 +1,217 @@
+#pragma once
+// Трассировка задач пула потоков.
+// Провилков Иван. группа 593.
+//
+// Каждый рабочий поток пишет события своих задач (постановка в очередь,
+// начало и конец выполнения) в собственный кольцевой буфер с одним
+// писателем и одним читателем, так что запись не трогает общих
+// кэш-линий. Читатель - экспорт в формат Chrome trace (его же открывает
+// Perfetto). Если экспорт не успевает, новые события выбрасываются и
+// считаются, а старые остаются: поток никогда не ждет читателя.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+// Монотонное время в наносекундах, общее для всех событий трассы.
+inline uint64_t TraceClockNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct TaskTraceEvent {
+  // Имя задачи должно жить дольше трассы, обычно это строковый литерал.
+  const char* name;
+  uint64_t submit_ns;
+  uint64_t start_ns;
+  uint64_t finish_ns;
+};
+
+// Кольцевой буфер событий: пишет только рабочий поток, читает только
+// экспорт.
+class TraceRing {
+ public:
+  explicit TraceRing(size_t capacity)
+      : mask_(RoundUpToPowerOfTwo(capacity) - 1), events_(mask_ + 1) {}
+
+  // Возвращает false и увеличивает счетчик потерь, если буфер полон.
+  bool TryPush(const TaskTraceEvent& event) {
+    const uint64_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cached_head_ > mask_) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+      if (tail - cached_head_ > mask_) {
+        dropped_.store(dropped_.load(std::memory_order_relaxed) + 1,
+                       std::memory_order_relaxed);
+        return false;
+      }
+    }
+    events_[tail & mask_] = event;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Забирает все накопленные события.
+  template <class Consumer>
+  void Drain(Consumer&& consumer) {
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    const uint64_t tail = tail_.load(std::memory_order_acquire);
+    for (; head != tail; ++head) {
+      consumer(events_[head & mask_]);
+    }
+    head_.store(head, std::memory_order_release);
+  }
+
+  uint64_t Dropped() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  static size_t RoundUpToPowerOfTwo(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+      result <<= 1;
+    }
+    return result;
+  }
+
+  const uint64_t mask_;
+  std::vector<TaskTraceEvent> events_;
+  // Поля писателя и читателя на разных кэш-линиях.
+  alignas(64) std::atomic<uint64_t> tail_{0};
+  uint64_t cached_head_ = 0;
+  std::atomic<uint64_t> dropped_{0};
+  alignas(64) std::atomic<uint64_t> head_{0};
+};
+
+// Счетчики рабочего потока. Обычно их пишет только сам поток, и
+// атомарность нужна лишь для чтения снаружи; для счетчиков с несколькими
+// писателями есть IncreaseShared.
+struct alignas(64) WorkerCounters {
+  std::atomic<uint64_t> started{0};
+  std::atomic<uint64_t> completed{0};
+  std::atomic<uint64_t> busy_ns{0};
+
+  static void Increase(std::atomic<uint64_t>& counter, uint64_t delta) {
+    counter.store(counter.load(std::memory_order_relaxed) + delta,
+                  std::memory_order_relaxed);
+  }
+
+  static void IncreaseShared(std::atomic<uint64_t>& counter, uint64_t delta) {
+    counter.fetch_add(delta, std::memory_order_relaxed);
+  }
+};
+
+// Снимок живых счетчиков пула.
+struct ThreadPoolStats {
+  uint64_t timestamp_ns = 0;
+  size_t workers = 0;
+  uint64_t submitted = 0;
+  uint64_t completed = 0;
+  // Задачи, которые поставлены, но еще не взяты рабочими.
+  uint64_t queue_depth = 0;
+  uint64_t busy_ns = 0;
+  // Задачи, выброшенные из очереди из-за отмены или истекшего срока.
+  uint64_t cancelled = 0;
+  // Задачи, отправленные на другой узел NUMA, потому что там простаивали
+  // рабочие, и задачи, забранные рабочими из очередей чужих узлов.
+  uint64_t spilled = 0;
+  uint64_t stolen = 0;
+  uint64_t dropped_events = 0;
+};
+
+// Пропускная способность и загрузка пула между двумя снимками.
+struct ThreadPoolRates {
+  double tasks_per_second = 0;
+  // Доля времени, которую рабочие провели в задачах, от 0 до 1.
+  double busy_ratio = 0;
+};
+
+inline ThreadPoolRates RatesBetween(const ThreadPoolStats& before,
+                                    const ThreadPoolStats& after) {
+  ThreadPoolRates rates;
+  const uint64_t elapsed_ns = after.timestamp_ns - before.timestamp_ns;
+  if (elapsed_ns == 0 || after.workers == 0) {
+    return rates;
+  }
+  rates.tasks_per_second =
+      (after.completed - before.completed) * 1e9 / elapsed_ns;
+  rates.busy_ratio = static_cast<double>(after.busy_ns - before.busy_ns) /
+      (static_cast<double>(elapsed_ns) * after.workers);
+  return rates;
+}
+
+// Пишет события в формате Chrome trace: одна дорожка на рабочий поток,
+// у каждой задачи в аргументах время ожидания в очереди.
+class ChromeTraceWriter {
+ public:
+  explicit ChromeTraceWriter(std::ostream& out) : out_(out) {
+    out_ << "{\"traceEvents\":[";
+  }
+
+  void ThreadName(size_t tid, const char* prefix) {
+    Separator();
+    out_ << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+         << tid << ",\"args\":{\"name\":\"" << prefix << ' ' << tid << "\"}}";
+  }
+
+  void Task(size_t tid, const TaskTraceEvent& event) {
+    Separator();
+    out_ << "{\"name\":\"";
+    WriteEscaped(event.name);
+    out_ << "\",\"cat\":\"task\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+         << ",\"ts\":";
+    WriteMicroseconds(event.start_ns);
+    out_ << ",\"dur\":";
+    WriteMicroseconds(event.finish_ns - event.start_ns);
+    out_ << ",\"args\":{\"queue_wait_us\":";
+    WriteMicroseconds(event.start_ns - event.submit_ns);
+    out_ << "}}";
+  }
+
+  void Finish(uint64_t dropped_events) {
+    out_ << "],\"displayTimeUnit\":\"ns\",\"otherData\":{\"dropped_events\":"
+         << dropped_events << "}}\n";
+  }
+
+ private:
+  void Separator() {
+    if (!first_) {
+      out_ << ",\n";
+    }
+    first_ = false;
+  }
+
+  void WriteMicroseconds(uint64_t ns) {
+    out_ << ns / 1000 << '.';
+    const uint64_t fraction = ns % 1000;
+    out_ << fraction / 100 << fraction / 10 % 10 << fraction % 10;
+  }
+
+  // Строка JSON: кавычка, обратная косая черта и управляющие символы
+  // (меньше 0x20) экранируются, иначе вся трасса перестанет читаться.
+  void WriteEscaped(const char* text) {
+    static const char kHex[] = "0123456789abcdef";
+    for (; *text != '\0'; ++text) {
+      const unsigned char symbol = static_cast<unsigned char>(*text);
+      if (symbol == '"' || symbol == '\\') {
+        out_ << '\\' << *text;
+      } else if (symbol == '\n') {
+        out_ << "\\n";
+      } else if (symbol == '\t') {
+        out_ << "\\t";
+      } else if (symbol == '\r') {
+        out_ << "\\r";
+      } else if (symbol < 0x20) {
+        out_ << "\\u00" << kHex[symbol >> 4] << kHex[symbol & 0xf];
+      } else {
+        out_ << *text;
+      }
+    }
+  }
+
+  std::ostream& out_;
+  bool first_ = true;
+};
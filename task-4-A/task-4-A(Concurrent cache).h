@@ -0,0 +1,422 @@
+#pragma once
+// Многопоточный кэш с вытеснением CLOCK.
+// Провилков Иван. группа 593.
+//
+// Устроен как StripedHashSet: ключи по хэшу делятся между полосами, у
+// каждой полосы свой std::shared_mutex, своя хэш-таблица и свое кольцо
+// CLOCK. Попадание берет полосу только на чтение: находит запись,
+// копирует значение и выставляет бит обращения (атомарный, и пишется,
+// только если он еще не выставлен). Вставка берет полосу на запись и,
+// пока байтов больше, чем доля полосы в capacity_bytes, вытесняет: стрелка
+// идет по кольцу, снимает бит обращения, а запись без бита выкидывает.
+//
+// GetOrLoad для промаха зовет loader вне блокировок, и одновременные
+// промахи по одному ключу ждут одну загрузку. Статистика
+// в счетчиках, разнесенных по кэш-линиям, чтобы попадания из разных
+// потоков не писали в одну линию.
+
+#include "../lock_profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct CacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  // Вызовы loader и те из них, что бросили исключение.
+  uint64_t loads = 0;
+  uint64_t load_failures = 0;
+  // Промахи, дождавшиеся чужой загрузки того же ключа.
+  uint64_t coalesced = 0;
+  uint64_t evictions = 0;
+  size_t entries = 0;
+  size_t bytes = 0;
+};
+
+// Вес записи по умолчанию - размер ключа и значения.
+template <class K, class V>
+struct CacheDefaultWeigher {
+  size_t operator()(const K&, const V&) const {
+    return sizeof(K) + sizeof(V);
+  }
+};
+
+namespace cache_detail {
+
+// Счетчик, разнесенный по кэш-линиям: поток пишет в свою ячейку, чтение
+// суммирует все.
+class StripedCounter {
+ public:
+  void Increase(uint64_t value = 1) {
+    cells_[ThisThreadCell()].value.fetch_add(value,
+                                             std::memory_order_relaxed);
+  }
+
+  uint64_t Load() const {
+    uint64_t sum = 0;
+    for (const Cell& cell : cells_) {
+      sum += cell.value.load(std::memory_order_relaxed);
+    }
+    return sum;
+  }
+
+ private:
+  static constexpr size_t kCells = 16;
+
+  struct alignas(64) Cell {
+    std::atomic<uint64_t> value{0};
+  };
+
+  static size_t ThisThreadCell() {
+    static std::atomic<size_t> next{0};
+    static thread_local const size_t cell =
+        next.fetch_add(1, std::memory_order_relaxed) % kCells;
+    return cell;
+  }
+
+  Cell cells_[kCells];
+};
+
+}  // namespace cache_detail
+
+template <class K, class V, class Hash = std::hash<K>,
+          class Weigher = CacheDefaultWeigher<K, V> >
+class ConcurrentCache {
+ public:
+  using mutex = lock_profiler::Profiled<std::shared_mutex>;
+
+  // capacity_bytes делится между полосами поровну, остаток раздается по
+  // байту первым полосам. Полос не больше capacity_bytes / (sizeof(K) +
+  // sizeof(V)), чтобы в каждую влезала хотя бы одна запись веса по
+  // умолчанию: иначе при маленьком бюджете кэш молча ничего бы не
+  // хранил. capacity_bytes должен быть не меньше одной такой записи.
+  explicit ConcurrentCache(const size_t capacity_bytes,
+                           const size_t concurrency_level = 16,
+                           const Weigher& weigher = Weigher())
+      : shards_(ShardCount(capacity_bytes, concurrency_level)),
+        weigher_(weigher) {
+    assert(capacity_bytes >= kMinEntryBytes &&
+           "ConcurrentCache capacity is smaller than one entry");
+    for (size_t i = 0; i < shards_.size(); ++i) {
+      shards_[i].capacity = capacity_bytes / shards_.size() +
+          (i < capacity_bytes % shards_.size() ? 1 : 0);
+      lock_profiler::SetName(shards_[i].lock, "ConcurrentCache::shard", i);
+    }
+  }
+
+  ConcurrentCache(const ConcurrentCache&) = delete;
+  ConcurrentCache& operator=(const ConcurrentCache&) = delete;
+
+  std::optional<V> Get(const K& key) {
+    std::optional<V> value = Find(ShardFor(key), key);
+    if (value) {
+      stats_.hits.Increase();
+    } else {
+      stats_.misses.Increase();
+    }
+    return value;
+  }
+
+  // Значение из кэша или результат loader(), который кладется в кэш.
+  // Если тот же ключ уже загружается, ждет ту загрузку. Исключение loader
+  // получают все ждавшие, и в кэш ничего не попадает. Если во время
+  // загрузки ключ записали через Put, все получают записанное значение;
+  // если удалили через Erase - загруженное, но в кэш оно не кладется.
+  template <class Loader>
+  V GetOrLoad(const K& key, Loader loader) {
+    Shard& shard = ShardFor(key);
+    if (std::optional<V> value = Find(shard, key)) {
+      stats_.hits.Increase();
+      return std::move(*value);
+    }
+    stats_.misses.Increase();
+    {
+      std::unique_lock<mutex> locker(shard.lock);
+      auto found = shard.index.find(key);
+      if (found != shard.index.end()) {
+        Touch(found->second);
+        return found->second.value;
+      }
+      if (Loading* loading = FindLoading(shard, key)) {
+        if (loading->flight == nullptr) {
+          loading->flight = std::make_shared<Flight>();
+        }
+        std::shared_ptr<Flight> flight = loading->flight;
+        stats_.coalesced.Increase();
+        shard.loaded.wait(locker, [&flight]() {
+          return flight->done;
+        });
+        if (flight->error != nullptr) {
+          std::rethrow_exception(flight->error);
+        }
+        return *flight->value;
+      }
+      shard.loading.push_back(Loading{key, nullptr, false});
+    }
+    stats_.loads.Increase();
+    std::optional<V> value;
+    std::exception_ptr error;
+    try {
+      value.emplace(loader());
+    } catch (...) {
+      stats_.load_failures.Increase();
+      error = std::current_exception();
+    }
+    {
+      std::unique_lock<mutex> locker(shard.lock);
+      Loading loading = TakeLoading(shard, key);
+      if (value) {
+        // Пока шла загрузка, Put мог положить более свежее значение, а
+        // Erase - удалить ключ. Тогда загруженное значение устарело: в
+        // кэш его не кладем, а ждавшим отдаем то, что лежит в кэше.
+        auto found = shard.index.find(key);
+        if (found != shard.index.end()) {
+          value = found->second.value;
+        } else if (!loading.invalidated) {
+          Store(shard, key, *value);
+        }
+      }
+      if (loading.flight != nullptr) {
+        loading.flight->value = value;
+        loading.flight->error = error;
+        loading.flight->done = true;
+        shard.loaded.notify_all();
+      }
+    }
+    if (error != nullptr) {
+      std::rethrow_exception(error);
+    }
+    return std::move(*value);
+  }
+
+  void Put(const K& key, V value) {
+    Shard& shard = ShardFor(key);
+    std::unique_lock<mutex> locker(shard.lock);
+    Invalidate(shard, key);
+    Store(shard, key, std::move(value));
+  }
+
+  bool Erase(const K& key) {
+    Shard& shard = ShardFor(key);
+    std::unique_lock<mutex> locker(shard.lock);
+    Invalidate(shard, key);
+    auto found = shard.index.find(key);
+    if (found == shard.index.end()) {
+      return false;
+    }
+    Remove(shard, found);
+    return true;
+  }
+
+  CacheStats Stats() const {
+    CacheStats stats;
+    stats.hits = stats_.hits.Load();
+    stats.misses = stats_.misses.Load();
+    stats.loads = stats_.loads.Load();
+    stats.load_failures = stats_.load_failures.Load();
+    stats.coalesced = stats_.coalesced.Load();
+    stats.evictions = stats_.evictions.Load();
+    for (const Shard& shard : shards_) {
+      stats.entries += shard.entries.load(std::memory_order_relaxed);
+      stats.bytes += shard.bytes.load(std::memory_order_relaxed);
+    }
+    return stats;
+  }
+
+ private:
+  struct Entry {
+    Entry(V value, size_t weight) : value(std::move(value)), weight(weight) {}
+
+    V value;
+    size_t weight;
+    // Бит CLOCK: выставляют попадания под блокировкой на чтение,
+    // снимает стрелка под блокировкой на запись.
+    std::atomic<bool> referenced{false};
+    // Кольцо CLOCK живет прямо в узлах хэш-таблицы.
+    const K* key = nullptr;
+    Entry* previous = nullptr;
+    Entry* next = nullptr;
+  };
+
+  using Index = std::unordered_map<K, Entry, Hash>;
+
+  // Результат загрузки для тех, кто ее ждет. Заводится, только когда
+  // появляется второй желающий, так что одиночный промах его не
+  // выделяет.
+  struct Flight {
+    bool done = false;
+    std::optional<V> value;
+    std::exception_ptr error;
+  };
+
+  struct Loading {
+    K key;
+    std::shared_ptr<Flight> flight;
+    // Во время загрузки ключ записали или удалили.
+    bool invalidated = false;
+  };
+
+  // Полосы в разных кэш-линиях, чтобы блокировки соседних не мешали.
+  struct alignas(64) Shard {
+    mutex lock;
+    std::condition_variable_any loaded;
+    Index index;
+    Entry* hand = nullptr;
+    // Загружаемые ключи; их единицы, так что хватает вектора.
+    std::vector<Loading> loading;
+    size_t capacity = 0;
+    // Пишутся под блокировкой на запись, читаются Stats без нее.
+    std::atomic<size_t> bytes{0};
+    std::atomic<size_t> entries{0};
+  };
+
+  struct Counters {
+    cache_detail::StripedCounter hits;
+    cache_detail::StripedCounter misses;
+    cache_detail::StripedCounter loads;
+    cache_detail::StripedCounter load_failures;
+    cache_detail::StripedCounter coalesced;
+    cache_detail::StripedCounter evictions;
+  };
+
+  static constexpr size_t kMinEntryBytes = sizeof(K) + sizeof(V);
+
+  static size_t ShardCount(const size_t capacity_bytes,
+                           const size_t concurrency_level) {
+    return std::max<size_t>(
+        std::min(concurrency_level, capacity_bytes / kMinEntryBytes), 1);
+  }
+
+  Shard& ShardFor(const K& key) {
+    return shards_[hash_function_(key) % shards_.size()];
+  }
+
+  static void Touch(Entry& entry) {
+    if (!entry.referenced.load(std::memory_order_relaxed)) {
+      entry.referenced.store(true, std::memory_order_relaxed);
+    }
+  }
+
+  std::optional<V> Find(Shard& shard, const K& key) {
+    std::shared_lock<mutex> locker(shard.lock);
+    auto found = shard.index.find(key);
+    if (found == shard.index.end()) {
+      return std::nullopt;
+    }
+    Touch(found->second);
+    return found->second.value;
+  }
+
+  static Loading* FindLoading(Shard& shard, const K& key) {
+    for (Loading& loading : shard.loading) {
+      if (loading.key == key) {
+        return &loading;
+      }
+    }
+    return nullptr;
+  }
+
+  static Loading TakeLoading(Shard& shard, const K& key) {
+    Loading* loading = FindLoading(shard, key);
+    std::swap(*loading, shard.loading.back());
+    Loading taken = std::move(shard.loading.back());
+    shard.loading.pop_back();
+    return taken;
+  }
+
+  static void Invalidate(Shard& shard, const K& key) {
+    if (Loading* loading = FindLoading(shard, key)) {
+      loading->invalidated = true;
+    }
+  }
+
+  // Дальше все под блокировкой полосы на запись.
+  void Store(Shard& shard, const K& key, V value) {
+    const size_t weight = weigher_(key, value);
+    auto found = shard.index.find(key);
+    if (found != shard.index.end()) {
+      Remove(shard, found);
+    }
+    if (weight > shard.capacity) {
+      // Не влезет даже в пустую полосу.
+      return;
+    }
+    while (shard.bytes.load(std::memory_order_relaxed) + weight >
+           shard.capacity) {
+      Evict(shard);
+    }
+    auto inserted = shard.index.emplace(
+        std::piecewise_construct, std::forward_as_tuple(key),
+        std::forward_as_tuple(std::move(value), weight)).first;
+    Entry& entry = inserted->second;
+    entry.key = &inserted->first;
+    // Новая запись встает прямо перед стрелкой: до нее стрелка дойдет
+    // последней.
+    if (shard.hand == nullptr) {
+      entry.previous = entry.next = &entry;
+      shard.hand = &entry;
+    } else {
+      entry.next = shard.hand;
+      entry.previous = shard.hand->previous;
+      entry.previous->next = &entry;
+      shard.hand->previous = &entry;
+    }
+    shard.bytes.store(shard.bytes.load(std::memory_order_relaxed) + weight,
+                      std::memory_order_relaxed);
+    shard.entries.store(shard.entries.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_relaxed);
+  }
+
+  void Evict(Shard& shard) {
+    while (true) {
+      Entry* entry = shard.hand;
+      if (entry->referenced.load(std::memory_order_relaxed)) {
+        entry->referenced.store(false, std::memory_order_relaxed);
+        shard.hand = entry->next;
+        continue;
+      }
+      Remove(shard, shard.index.find(*entry->key));
+      stats_.evictions.Increase();
+      return;
+    }
+  }
+
+  // Выкидывает запись, стрелка при этом переходит на следующую.
+  void Remove(Shard& shard, typename Index::iterator found) {
+    Entry& entry = found->second;
+    shard.bytes.store(shard.bytes.load(std::memory_order_relaxed) -
+                          entry.weight,
+                      std::memory_order_relaxed);
+    shard.entries.store(shard.entries.load(std::memory_order_relaxed) - 1,
+                        std::memory_order_relaxed);
+    if (entry.next == &entry) {
+      shard.hand = nullptr;
+    } else {
+      entry.previous->next = entry.next;
+      entry.next->previous = entry.previous;
+      if (shard.hand == &entry) {
+        shard.hand = entry.next;
+      }
+    }
+    shard.index.erase(found);
+  }
+
+  std::vector<Shard> shards_;
+  Counters stats_;
+  Hash hash_function_;
+  Weigher weigher_;
+};
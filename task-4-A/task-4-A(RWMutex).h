@@ -2,6 +2,9 @@
 // Многопоточная хэш-таблица с использованием RWMutex с приоритетом у писателей.
 // Провилков Иван
 
+#include "../lock_profiler.h"
+#include "task-4-A(Snapshot).h"
+
 #include <algorithm>
 #include <atomic>
 #include <condition_variable>
@@ -9,6 +12,7 @@
 #include <functional>
 #include <mutex>
 #include <shared_mutex>
+#include <string>
 #include <vector>
 
 
@@ -43,6 +47,27 @@ class RWMutex {
     ++readers_;
   }
 
+  // Захват без ожидания: удается, только если сейчас никто не пишет и
+  // (для писателя) никто не читает.
+  bool TryWriterLock() {
+    std::unique_lock<std::mutex> locker(gate_);
+    if (writing_ || readers_ > 0) {
+      return false;
+    }
+    ++writers_;
+    writing_ = true;
+    return true;
+  }
+
+  bool TryReaderLock() {
+    std::unique_lock<std::mutex> locker(gate_);
+    if (writers_ > 0) {
+      return false;
+    }
+    ++readers_;
+    return true;
+  }
+
   void ReaderUnlock() {
     std::unique_lock<std::mutex> locker(gate_);
     --readers_;
@@ -55,6 +80,10 @@ class RWMutex {
     WriterLock();
   }
 
+  bool try_lock() {
+    return TryWriterLock();
+  }
+
   void unlock() {
     WriterUnlock();
   }
@@ -63,6 +92,10 @@ class RWMutex {
     ReaderLock();
   }
 
+  bool try_lock_shared() {
+    return TryReaderLock();
+  }
+
   void unlock_shared() {
     ReaderUnlock();
   }
@@ -79,7 +112,7 @@ class RWMutex {
 template <typename T, class Hash = std::hash<T>>
 class StripedHashSet {
  public:
-  using mutex = RWMutex;
+  using mutex = lock_profiler::Profiled<RWMutex>;
   explicit StripedHashSet(const size_t concurrency_level,
                           const size_t growth_factor = 3,
                           const double max_load_factor = 0.75)
@@ -87,7 +120,11 @@ class StripedHashSet {
         max_load_factor_(max_load_factor),
         stripes_(concurrency_level),
         buckets_(concurrency_level * 3),
-        size_(0) {}
+        size_(0) {
+    for (size_t i = 0; i < stripes_.size(); ++i) {
+      lock_profiler::SetName(stripes_[i], "StripedHashSet::stripe", i);
+    }
+  }
 
   bool Insert(const T& element) {
     size_t hash_value = hash_function_(element);
@@ -129,6 +166,51 @@ class StripedHashSet {
     return size_;
   }
 
+  // Пишет снимок множества в path (см. task-4-A(Snapshot).h). Полосы
+  // копируются по одной под блокировкой этой полосы на чтение, остальные
+  // полосы в это время работают.
+  void SaveSnapshot(const std::string& path) {
+    std::vector<T> elements;
+    elements.reserve(size_);
+    for (size_t stripe = 0; stripe < stripes_.size(); ++stripe) {
+      std::shared_lock<mutex> locker(stripes_[stripe]);
+      // Полосе принадлежат корзины stripe, stripe + stripes, ...: число
+      // корзин всегда кратно числу полос.
+      for (size_t bucket = stripe; bucket < buckets_.size();
+           bucket += stripes_.size()) {
+        elements.insert(elements.end(), buckets_[bucket].begin(),
+                        buckets_[bucket].end());
+      }
+    }
+    snapshot_detail::Write(path, elements, hash_function_);
+  }
+
+  // Заменяет содержимое множества снимком из path. Корзин сразу
+  // столько, чтобы не понадобился рехэш, и раскладываются они в
+  // несколько потоков.
+  void LoadSnapshot(const std::string& path) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Snapshots support only trivially copyable elements");
+    snapshot_detail::MappedFile file(path);
+    const snapshot_detail::Image<T> image =
+        snapshot_detail::Parse<T>(file, path);
+    file.Advise(MADV_SEQUENTIAL);
+    const size_t count = image.header->element_count;
+    size_t bucket_count = stripes_.size() * 3;
+    while (count >= max_load_factor_ * bucket_count) {
+      bucket_count *= growth_factor_;
+    }
+    std::vector<std::forward_list<T>> buckets(bucket_count);
+    snapshot_detail::BuildBuckets(image.elements, count, buckets,
+                                  hash_function_);
+    std::vector<std::unique_lock<mutex>> lockers;
+    for (size_t i = 0; i < stripes_.size(); ++i) {
+      lockers.emplace_back(std::unique_lock<mutex>(stripes_[i]));
+    }
+    buckets_.swap(buckets);
+    size_ = count;
+  }
+
  private:
   size_t GetBucketIndex(const size_t hash_value) const {
     return hash_value % buckets_.size();
@@ -0,0 +1,416 @@
+#pragma once
+// Снимки StripedHashSet на диске.
+// Провилков Иван. группа 593.
+//
+// SaveSnapshot копирует полосы по одной, под блокировкой только этой
+// полосы, так что писатели остальных полос работают дальше. Снимок
+// нечеткий: каждая полоса - как была в момент ее копирования, но каждый
+// элемент попадает в него не больше одного раза (элемент всегда живет в
+// полосе hash % stripes, как бы ни менялись корзины).
+//
+// Формат (версия 1), все числа в порядке байт машины, которая писала:
+//   заголовок SnapshotHeader, 64 байта;
+//   таблица смещений: bucket_count + 1 чисел uint64_t, элементы корзины
+//   b - это [offsets[b], offsets[b + 1]);
+//   элементы подряд, выровненные на 64, сгруппированные по корзинам
+//   hash % bucket_count.
+// Файл пишется рядом во временный, сбрасывается на диск и
+// переименовывается, после чего сбрасывается и каталог, так что старый
+// снимок подменяется целиком и новый переживает сбой.
+//
+// LoadSnapshot отображает файл в память и раскладывает элементы по
+// корзинам множества в несколько потоков без блокировок. MappedSnapshot
+// отвечает на Contains прямо по отображенному файлу, ничего не строя.
+// Поддерживаются только тривиально копируемые T: они пишутся байтами.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <forward_list>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class SnapshotException : public std::exception {
+ public:
+  explicit SnapshotException(const std::string& log) : log_(log) {}
+  const char* what() const noexcept override {
+    return log_.c_str();
+  }
+  std::string log_;
+};
+
+namespace snapshot_detail {
+
+constexpr char kMagic[8] = {'S', 'T', 'R', 'S', 'E', 'T', 'S', 'N'};
+constexpr uint32_t kVersion = 1;
+constexpr uint32_t kByteOrder = 0x01020304;
+constexpr uint64_t kAlignment = 64;
+// Элементов в корзине файла в среднем.
+constexpr uint64_t kElementsPerBucket = 4;
+
+struct SnapshotHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t element_size;
+  uint64_t element_count;
+  uint64_t bucket_count;
+  uint64_t offsets_offset;
+  uint64_t elements_offset;
+  uint64_t reserved;
+};
+
+static_assert(sizeof(SnapshotHeader) == 64, "SnapshotHeader must be 64 bytes");
+
+inline uint64_t AlignUp(uint64_t value) {
+  return (value + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+inline SnapshotException SystemError(const std::string& action,
+                                     const std::string& path) {
+  return SnapshotException(action + " " + path + ": " + std::strerror(errno));
+}
+
+// Файл, отображенный в память только для чтения.
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& path) {
+    const int descriptor = open(path.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+      throw SystemError("Can't open", path);
+    }
+    struct stat status;
+    if (fstat(descriptor, &status) != 0) {
+      close(descriptor);
+      throw SystemError("Can't stat", path);
+    }
+    size_ = static_cast<size_t>(status.st_size);
+    if (size_ > 0) {
+      data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    }
+    close(descriptor);
+    if (data_ == MAP_FAILED) {
+      data_ = nullptr;
+      throw SystemError("Can't map", path);
+    }
+  }
+
+  MappedFile(MappedFile&& other) noexcept
+      : data_(std::exchange(other.data_, nullptr)),
+        size_(std::exchange(other.size_, 0)) {}
+  MappedFile& operator=(MappedFile&& other) noexcept {
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    return *this;
+  }
+
+  ~MappedFile() {
+    if (data_ != nullptr) {
+      munmap(data_, size_);
+    }
+  }
+
+  // Подсказка ядру, как будем читать: MADV_SEQUENTIAL, MADV_RANDOM.
+  void Advise(int advice) const {
+    if (data_ != nullptr) {
+      madvise(data_, size_, advice);
+    }
+  }
+
+  const unsigned char* Data() const {
+    return static_cast<const unsigned char*>(data_);
+  }
+
+  size_t Size() const {
+    return size_;
+  }
+
+ private:
+  void* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+// Разобранный и проверенный снимок.
+template <class T>
+struct Image {
+  const SnapshotHeader* header = nullptr;
+  const uint64_t* offsets = nullptr;
+  const T* elements = nullptr;
+};
+
+template <class T>
+Image<T> Parse(const MappedFile& file, const std::string& path) {
+  Image<T> image;
+  if (file.Size() < sizeof(SnapshotHeader)) {
+    throw SnapshotException("Snapshot " + path + " is truncated");
+  }
+  image.header = reinterpret_cast<const SnapshotHeader*>(file.Data());
+  const SnapshotHeader& header = *image.header;
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+    throw SnapshotException(path + " is not a StripedHashSet snapshot");
+  }
+  if (header.version != kVersion) {
+    throw SnapshotException("Snapshot " + path + " has unsupported version " +
+                            std::to_string(header.version));
+  }
+  if (header.byte_order != kByteOrder || header.element_size != sizeof(T)) {
+    throw SnapshotException("Snapshot " + path +
+                            " was written for another element type or machine");
+  }
+  // Поля поврежденного заголовка могут быть любыми, поэтому сначала
+  // ограничиваем их размером файла, а потом уже умножаем и складываем:
+  // иначе проверка переполнилась бы и пропустила выход за отображение.
+  const uint64_t file_size = file.Size();
+  if (header.bucket_count == 0 ||
+      header.bucket_count >= file_size / sizeof(uint64_t) ||
+      header.element_count > file_size / sizeof(T) ||
+      header.offsets_offset < sizeof(SnapshotHeader) ||
+      header.offsets_offset % alignof(uint64_t) != 0 ||
+      header.elements_offset % kAlignment != 0 ||
+      header.elements_offset > file_size ||
+      header.offsets_offset > header.elements_offset ||
+      (header.bucket_count + 1) * sizeof(uint64_t) >
+          header.elements_offset - header.offsets_offset ||
+      header.element_count * sizeof(T) > file_size - header.elements_offset) {
+    throw SnapshotException("Snapshot " + path + " is corrupted");
+  }
+  image.offsets = reinterpret_cast<const uint64_t*>(file.Data() +
+                                                    header.offsets_offset);
+  image.elements = reinterpret_cast<const T*>(file.Data() +
+                                              header.elements_offset);
+  if (image.offsets[0] != 0 ||
+      image.offsets[header.bucket_count] != header.element_count) {
+    throw SnapshotException("Snapshot " + path + " is corrupted");
+  }
+  for (uint64_t bucket = 0; bucket < header.bucket_count; ++bucket) {
+    if (image.offsets[bucket] > image.offsets[bucket + 1]) {
+      throw SnapshotException("Snapshot " + path + " is corrupted");
+    }
+  }
+  return image;
+}
+
+inline void WriteAll(int descriptor, const void* data, size_t size,
+                     const std::string& path) {
+  const char* position = static_cast<const char*>(data);
+  while (size > 0) {
+    const ssize_t written = write(descriptor, position, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw SystemError("Can't write", path);
+    }
+    position += written;
+    size -= static_cast<size_t>(written);
+  }
+}
+
+// Переименование попадает на диск вместе с каталогом: без его fsync
+// после сбоя на месте path может оказаться старый снимок или ничего.
+inline void SyncDirectory(const std::string& path) {
+  const size_t slash = path.rfind('/');
+  const std::string directory = slash == std::string::npos
+      ? "."
+      : (slash == 0 ? "/" : path.substr(0, slash));
+  const int descriptor = open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+  if (descriptor < 0) {
+    throw SystemError("Can't open directory", directory);
+  }
+  const int result = fsync(descriptor);
+  close(descriptor);
+  if (result != 0) {
+    throw SystemError("Can't sync directory", directory);
+  }
+}
+
+// Пишет elements (в любом порядке) в формате снимка.
+template <class T, class Hash>
+void Write(const std::string& path, const std::vector<T>& elements,
+           const Hash& hash_function) {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "Snapshots support only trivially copyable elements");
+  SnapshotHeader header{};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.byte_order = kByteOrder;
+  header.element_size = sizeof(T);
+  header.element_count = elements.size();
+  header.bucket_count = elements.size() / kElementsPerBucket + 1;
+  header.offsets_offset = sizeof(SnapshotHeader);
+  header.elements_offset = AlignUp(
+      header.offsets_offset + (header.bucket_count + 1) * sizeof(uint64_t));
+
+  // Раскладка по корзинам сортировкой подсчетом.
+  std::vector<uint64_t> buckets(elements.size());
+  std::vector<uint64_t> offsets(header.bucket_count + 1, 0);
+  for (size_t i = 0; i < elements.size(); ++i) {
+    buckets[i] = hash_function(elements[i]) % header.bucket_count;
+    ++offsets[buckets[i] + 1];
+  }
+  for (uint64_t bucket = 0; bucket < header.bucket_count; ++bucket) {
+    offsets[bucket + 1] += offsets[bucket];
+  }
+  // Байтовый буфер, а не std::vector<T>: тривиально копируемый T не
+  // обязан иметь конструктор по умолчанию.
+  std::vector<unsigned char> sorted(elements.size() * sizeof(T));
+  {
+    std::vector<uint64_t> next(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < elements.size(); ++i) {
+      std::memcpy(sorted.data() + next[buckets[i]]++ * sizeof(T),
+                  &elements[i], sizeof(T));
+    }
+  }
+
+  const std::string temporary = path + ".tmp";
+  const int descriptor = open(temporary.c_str(),
+                              O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (descriptor < 0) {
+    throw SystemError("Can't create", temporary);
+  }
+  try {
+    const std::vector<char> padding(kAlignment, 0);
+    WriteAll(descriptor, &header, sizeof(header), temporary);
+    WriteAll(descriptor, offsets.data(), offsets.size() * sizeof(uint64_t),
+             temporary);
+    WriteAll(descriptor, padding.data(),
+             header.elements_offset - header.offsets_offset -
+                 offsets.size() * sizeof(uint64_t),
+             temporary);
+    WriteAll(descriptor, sorted.data(), sorted.size(), temporary);
+    if (fsync(descriptor) != 0) {
+      throw SystemError("Can't sync", temporary);
+    }
+  } catch (...) {
+    close(descriptor);
+    unlink(temporary.c_str());
+    throw;
+  }
+  close(descriptor);
+  if (rename(temporary.c_str(), path.c_str()) != 0) {
+    unlink(temporary.c_str());
+    throw SystemError("Can't rename snapshot to", path);
+  }
+  SyncDirectory(path);
+}
+
+// Раскладывает count элементов по корзинам buckets (hash % размер) в
+// несколько потоков. Сначала каждый поток делит свой кусок элементов по
+// владельцам корзин (корзина b принадлежит потоку b % threads), потом
+// каждый владелец заполняет свои корзины, так что корзину пишет один
+// поток и блокировки не нужны.
+template <class T, class Hash>
+void BuildBuckets(const T* elements, size_t count,
+                  std::vector<std::forward_list<T> >& buckets,
+                  const Hash& hash_function) {
+  constexpr size_t kElementsPerThread = 1 << 16;
+  const size_t threads = std::max<size_t>(
+      1, std::min<size_t>(std::thread::hardware_concurrency(),
+                          count / kElementsPerThread));
+  const size_t bucket_count = buckets.size();
+  // owned[source][owner] - номера элементов куска source для owner.
+  std::vector<std::vector<std::vector<size_t> > > owned(
+      threads, std::vector<std::vector<size_t> >(threads));
+  auto run = [threads](auto body) {
+    std::vector<std::thread> workers;
+    for (size_t index = 1; index < threads; ++index) {
+      workers.emplace_back(body, index);
+    }
+    body(0);
+    for (std::thread& worker : workers) {
+      worker.join();
+    }
+  };
+  run([&](size_t source) {
+    const size_t begin = count * source / threads;
+    const size_t end = count * (source + 1) / threads;
+    for (size_t i = begin; i < end; ++i) {
+      owned[source][hash_function(elements[i]) % bucket_count % threads]
+          .push_back(i);
+    }
+  });
+  run([&](size_t owner) {
+    for (size_t source = 0; source < threads; ++source) {
+      for (size_t i : owned[source][owner]) {
+        buckets[hash_function(elements[i]) % bucket_count].push_front(
+            elements[i]);
+      }
+    }
+  });
+}
+
+}  // namespace snapshot_detail
+
+// Снимок, отображенный в память, как множество только для чтения.
+// Contains ищет в одной корзине файла, ничего не загружая целиком;
+// страницы подтягиваются при обращении.
+template <class T, class Hash = std::hash<T> >
+class MappedSnapshot {
+ public:
+  static_assert(std::is_trivially_copyable<T>::value,
+                "Snapshots support only trivially copyable elements");
+
+  explicit MappedSnapshot(const std::string& path,
+                          const Hash& hash_function = Hash())
+      : file_(path), image_(snapshot_detail::Parse<T>(file_, path)),
+        hash_function_(hash_function) {
+    CheckHash(path);
+    file_.Advise(MADV_RANDOM);
+  }
+
+  bool Contains(const T& element) const {
+    const uint64_t bucket =
+        hash_function_(element) % image_.header->bucket_count;
+    const T* begin = image_.elements + image_.offsets[bucket];
+    const T* end = image_.elements + image_.offsets[bucket + 1];
+    return std::find(begin, end, element) != end;
+  }
+
+  size_t Size() const {
+    return image_.header->element_count;
+  }
+
+  const T* begin() const {
+    return image_.elements;
+  }
+
+  const T* end() const {
+    return image_.elements + Size();
+  }
+
+ private:
+  // Корзины файла посчитаны хэш-функцией писавшего. Если у нас она
+  // другая (другая Hash или другая стандартная библиотека), поиск по
+  // корзинам врал бы, поэтому проверяем выборку элементов.
+  void CheckHash(const std::string& path) const {
+    constexpr size_t kSamples = 64;
+    const uint64_t bucket_count = image_.header->bucket_count;
+    for (size_t sample = 0; sample < std::min<size_t>(kSamples, Size());
+         ++sample) {
+      const uint64_t index = Size() * sample / std::min<size_t>(kSamples,
+                                                                Size());
+      const uint64_t bucket = hash_function_(image_.elements[index]) %
+          bucket_count;
+      if (index < image_.offsets[bucket] ||
+          index >= image_.offsets[bucket + 1]) {
+        throw SnapshotException("Snapshot " + path +
+                                " was written with another hash function");
+      }
+    }
+  }
+
+  snapshot_detail::MappedFile file_;
+  snapshot_detail::Image<T> image_;
+  Hash hash_function_;
+};
@@ -2,25 +2,35 @@
 // Многопоточная хэш-таблица.
 // Провилков Иван
 
+#include "../lock_profiler.h"
+#include "task-4-A(Snapshot).h"
+
 #include <algorithm>
 #include <atomic>
 #include <forward_list>
 #include <functional>
 #include <mutex>
+#include <string>
 #include <vector>
 
 template <typename T, class Hash = std::hash<T>>
 class StripedHashSet {
  public:
+  using mutex = lock_profiler::Profiled<std::mutex>;
+
   explicit StripedHashSet(const size_t concurrency_level,
                           const size_t growth_factor = 3,
                           const double max_load_factor = 0.75)
       : growth_factor_(growth_factor), max_load_factor_(max_load_factor),
         stripes_(concurrency_level), buckets_(concurrency_level * 3),
-        size_(0) {}
+        size_(0) {
+    for (size_t i = 0; i < stripes_.size(); ++i) {
+      lock_profiler::SetName(stripes_[i], "StripedHashSet::stripe", i);
+    }
+  }
   bool Insert(const T& element) {
     size_t hash_value = hash_function_(element);
-    std::unique_lock<std::mutex> locker(stripes_[GetStripeIndex(hash_value)]);
+    std::unique_lock<mutex> locker(stripes_[GetStripeIndex(hash_value)]);
     if (find_element(hash_value, element)) {
       // Элемент уже был в контейнере.
       return false;
@@ -37,7 +47,7 @@ class StripedHashSet {
 
   bool Remove(const T& element) {
     size_t hash_value = hash_function_(element);
-    std::unique_lock<std::mutex> locker(stripes_[GetStripeIndex(hash_value)]);
+    std::unique_lock<mutex> locker(stripes_[GetStripeIndex(hash_value)]);
     if (find_element(hash_value, element)) {
       buckets_[GetBucketIndex(hash_value)].remove(element);
       --size_;
@@ -48,7 +58,7 @@ class StripedHashSet {
   }
   bool Contains(const T& element) {
     size_t hash_value = hash_function_(element);
-    std::unique_lock<std::mutex> locker(stripes_[GetStripeIndex(hash_value)]);
+    std::unique_lock<mutex> locker(stripes_[GetStripeIndex(hash_value)]);
     if (find_element(hash_value, element)) {
       return true;
     } else {
@@ -59,6 +69,51 @@ class StripedHashSet {
   size_t Size()const {
     return size_;
   }
+
+  // Пишет снимок множества в path (см. task-4-A(Snapshot).h). Полосы
+  // копируются по одной под блокировкой только этой полосы, остальные
+  // полосы в это время работают.
+  void SaveSnapshot(const std::string& path) {
+    std::vector<T> elements;
+    elements.reserve(size_);
+    for (size_t stripe = 0; stripe < stripes_.size(); ++stripe) {
+      std::unique_lock<mutex> locker(stripes_[stripe]);
+      // Полосе принадлежат корзины stripe, stripe + stripes, ...: число
+      // корзин всегда кратно числу полос.
+      for (size_t bucket = stripe; bucket < buckets_.size();
+           bucket += stripes_.size()) {
+        elements.insert(elements.end(), buckets_[bucket].begin(),
+                        buckets_[bucket].end());
+      }
+    }
+    snapshot_detail::Write(path, elements, hash_function_);
+  }
+
+  // Заменяет содержимое множества снимком из path. Корзин сразу
+  // столько, чтобы не понадобился рехэш, и раскладываются они в
+  // несколько потоков.
+  void LoadSnapshot(const std::string& path) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Snapshots support only trivially copyable elements");
+    snapshot_detail::MappedFile file(path);
+    const snapshot_detail::Image<T> image =
+        snapshot_detail::Parse<T>(file, path);
+    file.Advise(MADV_SEQUENTIAL);
+    const size_t count = image.header->element_count;
+    size_t bucket_count = stripes_.size() * 3;
+    while (count >= max_load_factor_ * bucket_count) {
+      bucket_count *= growth_factor_;
+    }
+    std::vector<std::forward_list<T>> buckets(bucket_count);
+    snapshot_detail::BuildBuckets(image.elements, count, buckets,
+                                  hash_function_);
+    std::vector<std::unique_lock<mutex>> lockers;
+    for (size_t i = 0; i < stripes_.size(); ++i) {
+      lockers.emplace_back(std::unique_lock<mutex>(stripes_[i]));
+    }
+    buckets_.swap(buckets);
+    size_ = count;
+  }
  private:
   size_t GetBucketIndex(const size_t hash_value)const {
     return hash_value % buckets_.size();
@@ -74,14 +129,14 @@ class StripedHashSet {
                      buckets_[GetBucketIndex(hash_value)].end(), element) !=
         buckets_[GetBucketIndex(hash_value)].end();
   }
-  void Rehash(std::unique_lock<std::mutex>& current_lock) {
+  void Rehash(std::unique_lock<mutex>& current_lock) {
     current_lock.unlock();
-    std::vector<std::unique_lock<std::mutex>> lockers;
-    lockers.emplace_back(std::unique_lock<std::mutex>(stripes_[0]));
+    std::vector<std::unique_lock<mutex>> lockers;
+    lockers.emplace_back(std::unique_lock<mutex>(stripes_[0]));
     if (!TimeToRehash())
       return;
     for (size_t i = 1; i < stripes_.size(); ++i) {
-      lockers.emplace_back(std::unique_lock<std::mutex>(stripes_[i]));
+      lockers.emplace_back(std::unique_lock<mutex>(stripes_[i]));
     }
     std::vector<std::forward_list<T>> past_buckets(buckets_.size() *
         growth_factor_);
@@ -96,7 +151,7 @@ class StripedHashSet {
   }
   size_t growth_factor_;
   double max_load_factor_;
-  std::vector<std::mutex> stripes_;
+  std::vector<mutex> stripes_;
   std::vector<std::forward_list<T> > buckets_;
   // Количество элементов в множестве.
   std::atomic<size_t> size_;
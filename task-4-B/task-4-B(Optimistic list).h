@@ -4,6 +4,7 @@
 // Провилков Иван.
 
 #include "arena_allocator.h"
+#include "../lock_profiler.h"
 
 #include <atomic>
 #include <limits>
@@ -40,16 +41,24 @@ class SpinLock {
     }
   }
 
+  bool TryLock() {
+    return !observer_.load() && !observer_.exchange(true);
+  }
+
   void Unlock() {
     observer_.store(false);
   }
 
-  // adapters for BasicLockable concept
+  // adapters for Lockable concept
 
   void lock() {
     Lock();
   }
 
+  bool try_lock() {
+    return TryLock();
+  }
+
   void unlock() {
     Unlock();
   }
@@ -63,10 +72,17 @@ class SpinLock {
 template <typename T>
 class OptimisticLinkedSet {
  private:
+  // Мьютексов в узлах слишком много, чтобы профилировать каждый отдельно,
+  // поэтому статистика общая на все узлы.
+  struct NodeLockSite {
+    static constexpr const char* kName = "OptimisticLinkedSet::Node";
+  };
+  using NodeLock = lock_profiler::Profiled<SpinLock, NodeLockSite>;
+
   struct Node {
     T element_;
     std::atomic<Node*> next_;
-    SpinLock lock_{};
+    NodeLock lock_{};
     std::atomic<bool> marked_{false};
 
     Node(const T& element, Node* next = nullptr)
@@ -94,8 +110,8 @@ class OptimisticLinkedSet {
   bool Insert(const T& element) {
     while(true) {
       Edge position = Locate(element);
-      std::unique_lock <SpinLock> previous_locker(position.pred_->lock_);
-      std::unique_lock <SpinLock> current_locker(position.curr_->lock_);
+      std::unique_lock<NodeLock> previous_locker(position.pred_->lock_);
+      std::unique_lock<NodeLock> current_locker(position.curr_->lock_);
       if (Validate(position)) {
         if (position.curr_->element_ == element) {
           return false;
@@ -114,8 +130,8 @@ class OptimisticLinkedSet {
   bool Remove(const T& element) {
     while (true) {
       Edge position = Locate(element);
-      std::unique_lock<SpinLock> previous_locker(position.pred_->lock_);
-      std::unique_lock<SpinLock> current_locker(position.curr_->lock_);
+      std::unique_lock<NodeLock> previous_locker(position.pred_->lock_);
+      std::unique_lock<NodeLock> current_locker(position.curr_->lock_);
       if (Validate(position)) {
         if (position.curr_->element_ != element) {
           return false;